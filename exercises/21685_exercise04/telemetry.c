@@ -0,0 +1,116 @@
+#include <telemetry.h>
+
+#ifdef TELEMETRY
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static double elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) * 1e9 + (double)(now.tv_nsec - start->tv_nsec);
+}
+
+/*
+ * Start recording a run of a loop.
+ *
+ * Parameters:
+ *		out: t - the record to fill in
+ *		in: loop - the name of the loop (not copied, so it must outlive t)
+ *		in: cap - the most iterations the loop will do, 0 if there is no limit
+ */
+void telemetry_start(Telemetry *t, const char *loop, int cap)
+{
+	t->loop = loop;
+	t->cap = cap;
+	t->iterations = 0;
+	t->capped = false;
+	clock_gettime(CLOCK_MONOTONIC, &t->start);
+}
+
+/*
+ * Record the end of one iteration.  Only the first TELEMETRY_MAX_STEPS iterations
+ * are kept, but all of them are counted.
+ *
+ * Parameters:
+ *		in/out: t - the record
+ *		in: delta - how much the guess moved this iteration
+ *		in: residual - the square of the guess minus the value
+ */
+void telemetry_step(Telemetry *t, long double delta, long double residual)
+{
+	if (t->iterations < TELEMETRY_MAX_STEPS) {
+		TelemetryStep *s = &t->step[t->iterations];
+		s->delta = delta;
+		s->residual = residual;
+		s->ns = elapsed_ns(&t->start);
+	}
+	t->iterations++;
+}
+
+/*
+ * Record the end of the loop.  If the loop stopped because it reached its
+ * iteration limit rather than because it converged, a warning is printed, since
+ * the result is then less accurate than the loop was asked for.
+ *
+ * Parameters:
+ *		in/out: t - the record
+ *		in: converged - whether the loop's stopping test was met
+ */
+void telemetry_end(Telemetry *t, bool converged)
+{
+	t->capped = !converged && t->cap > 0 && t->iterations >= t->cap;
+	if (t->capped) {
+		fprintf(stderr, "Warning: %s stopped at its limit of %d iterations without converging\n", t->loop, t->cap);
+	}
+}
+
+/*
+ * Write the record to the file named by the TELEMETRY_OUT environment variable, as
+ * JSON if the name ends in .json and as CSV otherwise.  If TELEMETRY_OUT is not
+ * set, CSV is written to stderr.
+ *
+ * Returns:
+ *		0 on success, else 1
+ */
+int telemetry_write(const Telemetry *t)
+{
+	const char *name = getenv("TELEMETRY_OUT");
+	FILE *fp = stderr;
+	if (name && *name) {
+		fp = fopen(name, "w");
+		if (!fp) {
+			fprintf(stderr, "Unable to open %s for writing\n", name);
+			return 1;
+		}
+	}
+	size_t len = name ? strlen(name) : 0;
+	bool json = len >= 5 && strcmp(name + len - 5, ".json") == 0;
+	int kept = t->iterations < TELEMETRY_MAX_STEPS ? t->iterations : TELEMETRY_MAX_STEPS;
+
+	if (json) {
+		fprintf(fp, "{\"loop\": \"%s\", \"iterations\": %d, \"cap\": %d, \"capped\": %s, \"steps\": [",
+				t->loop, t->iterations, t->cap, t->capped ? "true" : "false");
+		for (int i=0; i<kept; i++) {
+			fprintf(fp, "%s\n  {\"iteration\": %d, \"delta\": %.6Le, \"residual\": %.6Le, \"ns\": %.0f}",
+					i ? "," : "", i + 1, t->step[i].delta, t->step[i].residual, t->step[i].ns);
+		}
+		fprintf(fp, "\n]}\n");
+	}
+	else {
+		fprintf(fp, "loop,iteration,delta,residual,ns,capped\n");
+		for (int i=0; i<kept; i++) {
+			fprintf(fp, "%s,%d,%.6Le,%.6Le,%.0f,%d\n", t->loop, i + 1, t->step[i].delta,
+					t->step[i].residual, t->step[i].ns, t->capped);
+		}
+	}
+
+	if (fp != stderr) {
+		fclose(fp);
+	}
+	return 0;
+}
+
+#endif
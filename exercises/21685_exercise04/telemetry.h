@@ -0,0 +1,61 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/*
+ * Convergence telemetry for the square root loops.  Build with "make TELEMETRY=1"
+ * to record, for every iteration of a loop, how far apart the last two guesses were,
+ * how far the square of the guess is from the value, and when the iteration ended.
+ * Without TELEMETRY the macros below expand to nothing, so the loops are exactly as
+ * they were.
+ *
+ * TELEMETRY_WRITE writes the records to the file named by the TELEMETRY_OUT
+ * environment variable (JSON if the name ends in .json, otherwise CSV) or, if it is
+ * not set, as CSV to stderr.
+ */
+
+#ifdef TELEMETRY
+
+#include <stdbool.h>
+#include <time.h>
+
+#define TELEMETRY_MAX_STEPS	256		// iterations recorded per loop; the count goes on past this
+
+// one iteration of a loop
+typedef struct telemetry_step_struct {
+	long double delta;				// what the loop tests: the move in the guess, or the bracket width
+	long double residual;			// guess * guess - value
+	double ns;						// time since the loop started
+} TelemetryStep;
+
+// one run of a loop
+typedef struct telemetry_struct {
+	const char *loop;				// name of the loop, for the output
+	int cap;						// the loop's iteration limit, 0 if it has none
+	int iterations;
+	bool capped;					// the loop stopped at cap without converging
+	struct timespec start;
+	TelemetryStep step[TELEMETRY_MAX_STEPS];
+} Telemetry;
+
+void telemetry_start(Telemetry *t, const char *loop, int cap);
+void telemetry_step(Telemetry *t, long double delta, long double residual);
+void telemetry_end(Telemetry *t, bool converged);
+int telemetry_write(const Telemetry *t);
+
+#define TELEMETRY_DECLARE(t)					Telemetry t
+#define TELEMETRY_START(t, loop, cap)			telemetry_start(&(t), (loop), (cap))
+#define TELEMETRY_STEP(t, delta, residual)		telemetry_step(&(t), (delta), (residual))
+#define TELEMETRY_END(t, converged)				telemetry_end(&(t), (converged))
+#define TELEMETRY_WRITE(t)						telemetry_write(&(t))
+
+#else
+
+#define TELEMETRY_DECLARE(t)
+#define TELEMETRY_START(t, loop, cap)
+#define TELEMETRY_STEP(t, delta, residual)
+#define TELEMETRY_END(t, converged)
+#define TELEMETRY_WRITE(t)
+
+#endif
+
+#endif
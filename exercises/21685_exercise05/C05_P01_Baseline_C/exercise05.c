@@ -4,8 +4,17 @@
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <time.h>
 
+#include <telemetry.h>
+
 #define SQR2_FILE	"SquareRootTwo.txt"
 
 char *read_file(const char *file_name);
@@ -21,25 +30,31 @@ char *read_file(const char *file_name);
  */
 int main(void)
 {
-    clock_t start, stop, total;
+    clock_t start, stop;
+    double total;					// elapsed time in milliseconds
 	double value = 2;				// Find the square root of this number
 	double sig = 1E+10;				// Used to establish the limit for ending the loop
 	double old_guess = value / 2;	// This is the initial guess
 	double new_guess = old_guess; 	// set up the newGuess to be the same as the guess
 	double limit;					// The limit that determines the end of the loop
 	int i = 0;						// Loop iteration counter
+	TELEMETRY_DECLARE(telemetry);	// iteration records, if built with TELEMETRY
 
     start = clock();
+	TELEMETRY_START(telemetry, "newton", 20);
 	// This is the implementation of Newton's method for finding square root
 	do {
 		i++;						// Keep track of the number of iterations
 		old_guess = new_guess;		// Establish the current guess based on the new_guess from before
 		new_guess = (old_guess + value / old_guess) / 2.0;	// compute new guess based on old_guess
 		limit = new_guess / sig;		// Establish the limit to be relative to the size of the guess...
+		TELEMETRY_STEP(telemetry, fabs(old_guess - new_guess), (long double)new_guess * new_guess - value);
 		// Keep looping as long as the difference between the two guesses is larger than the relative
 		// limit and the number of iterations is not too large
 	} while (fabs(old_guess - new_guess) > limit && i < 20);
     stop = clock();
+	TELEMETRY_END(telemetry, fabs(old_guess - new_guess) <= limit);
+	TELEMETRY_WRITE(telemetry);
 
 	// Display the calculated square root
 	printf("\nThe square root of two is: %lf\n", new_guess);
@@ -88,7 +103,7 @@ int main(void)
 	else
 		printf("The numbers differ at position %d.\n", i+1);
 
-    total = (double)(stop-start);
+    total = (double)(stop-start) * 1000.0 / CLOCKS_PER_SEC;
     printf("\nTotal time %.3f milliseconds\n", total);
 
 	// free the memory we used
@@ -106,6 +121,10 @@ int main(void)
  * present.  (The input file is expected to contain a decimal number, possibly with leading
  * and/or trailing spaces and embedded newlines).
  *
+ * The file is memory mapped and filtered in a single pass.  Runs of 16 digits are found
+ * with vector compares and copied to the string as a block; only blocks containing other
+ * characters are looked at one character at a time.
+ *
  * Parameters:
  * 		in: file_name - the name of the file to read
  *
@@ -115,62 +134,89 @@ int main(void)
  */
 char *read_file(const char *file_name)
 {
-	// open the file for reading
-	FILE *fp = fopen(file_name, "r");
-	if (fp == NULL) {
+	// open the file for reading and find out how big it is
+	int fd = open(file_name, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
 		fprintf(stderr, "Unable to open %s for reading\n", file_name);
+		if (fd >= 0)
+			close(fd);
 		return NULL;
 	}
-
-	// determine the size of the file by reading each character one by one until we get
-	// to end of file, then rewinding the file pointer back to the beginning
-	size_t size = 0;
-	while(fgetc(fp) != EOF) {
-		size++;
-	}
-	rewind(fp);
-
-	size ++;	// add one for the null byte on the end
+	size_t size = (size_t)st.st_size;
 
 	// allocate space for the contents of the file, include space for the null at the end
 	// of the string
-	char *buf = (char *)malloc(size);
+	char *buf = (char *)malloc(size + 1);
 	if(!buf) {
-		fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) size);
+		fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) size + 1);
+		close(fd);
 		return NULL;
 	}
 
-	// Read the file one character at a time and store the characters in
-	// the buffer.  Skip newlines. In fact, skip all characters that are not digits.
-	// Allow one decimal point.  This has the side effect of validing that the input
-	// file actually contains a float number.
+	// map the file into memory.  The mapping stays valid after the file is closed.
+	const char *data = NULL;
+	if (size > 0) {
+		data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			fprintf(stderr, "Unable to read %s\n", file_name);
+			free(buf);
+			close(fd);
+			return NULL;
+		}
+		madvise((void *)data, size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	// Go through the file and store the characters in the buffer.  Skip newlines.
+	// In fact, skip all characters that are not digits. Allow one decimal point.  This
+	// has the side effect of validing that the input file actually contains a float number.
 	bool have_decimal = false;
-	int i;
+	size_t i = 0;
 	char *p = buf;
-	for (i=0; i<size; i++) {
-		char c = (char)fgetc(fp);
-		if (c == '.') {
-			if(have_decimal) {
-				// found more than one decimal point
-				fprintf(stderr, "Input from %s is not a valid float in decimal format\n", file_name);
-				free(buf);
-				fclose(fp);
-				return NULL;
+	while (i < size) {
+#ifdef __SSE2__
+		if (i + 16 <= size) {
+			// a byte is a digit if byte - '0' is less than 10 (as an unsigned value)
+			__m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+			__m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+			__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+			if (_mm_movemask_epi8(is_digit) == 0xffff) {
+				_mm_storeu_si128((__m128i *)p, v);		// all digits - save them all
+				p += 16;
+				i += 16;
+				continue;
+			}
+		}
+#endif
+		// the rest of the block is done one character at a time
+		size_t end = i + 16 < size ? i + 16 : size;
+		for (; i<end; i++) {
+			char c = data[i];
+			if (c == '.') {
+				if(have_decimal) {
+					// found more than one decimal point
+					fprintf(stderr, "Input from %s is not a valid float in decimal format\n", file_name);
+					free(buf);
+					munmap((void *)data, size);
+					return NULL;
+				}
+				have_decimal = true;
+				*(p++) = c;		// save the decimal point
+			} else if (c >= '0' && c <= '9') {
+				*(p++) = c;		// save the digit
 			}
-			have_decimal = true;
-			*(p++) = c;		// save the decimal point
-		} else if (isdigit(c)) {
-			*(p++) = c;		// save the digit
+			// else do nothing - do not save the character
 		}
-		// else do nothing - do not save the character
 	}
 
 	// null-terminate the buffer (so that it becomes a string)
 	*p = '\0';
 
-	// close the input file
-	fclose(fp);
+	// done with the file
+	if (size > 0)
+		munmap((void *)data, size);
 
 	// return the data from the file as a null-terminated string
-    return buf;
+	return buf;
 }
@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#include <sqroot.h>
+
+#define DEFAULT_COUNT	1000000		// number of random values when no file is given
+#define INPUT_SIZE		512			// reasonably large for a line containing one double
+#define OPS_PER_SAMPLE	1000		// single value calls timed together as one sample
+#define WARMUP_SAMPLES	50			// samples run and thrown away before timing
+#define DEFAULT_SAMPLES	1000		// timed samples for each single value strategy
+#define BATCH_SAMPLES	20			// timed samples for each whole array strategy
+
+// results of timing one strategy
+typedef struct result_struct {
+	const char *name;
+	double ns_per_op;		// mean
+	double p50;				// median ns per operation
+	double p99;				// 99th percentile ns per operation
+	int iterations;			// loop iterations per operation, -1 if not applicable
+	int samples;
+} Result;
+
+// the input to the single value strategies.  It is volatile so that the compiler
+// can not work out the answer once and hoist it out of the timing loop.
+static volatile double bench_value = 2;
+static volatile double sink;		// results are stored here so they are not optimized away
+
+static const double *batch_in;		// input and output of the whole array strategies
+static double *batch_out;
+static size_t batch_n;
+
+/*
+ * Return the time in nanoseconds from a monotonic clock.
+ */
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * The bisection search from exercise04, for any value.
+ */
+static long double sqrt_bisect(double value, int *iterations)
+{
+	long double new_guess = 0;
+	long double l = (long double)sqrt(value), r = value > 1 ? value : 1, precision = 1e-18;
+	int i = 0;
+	while(r-l>precision) {
+		i++;
+		new_guess = (r+l)/2;
+		if (new_guess*new_guess>value) {
+			r = new_guess-precision;
+		}
+		else if (new_guess*new_guess<value) {
+			l = new_guess+precision;
+		}
+		else {
+			break;
+		}
+	}
+	*iterations = i;
+	return new_guess;
+}
+
+/*
+ * The Newton's method loop from exercise05, for any value.
+ */
+static double sqrt_newton_counted(double value, int *iterations)
+{
+	double sig = 1E+10;
+	double old_guess = value / 2;
+	double new_guess = old_guess;
+	double limit;
+	int i = 0;
+	do {
+		i++;
+		old_guess = new_guess;
+		new_guess = (old_guess + value / old_guess) / 2.0;
+		limit = new_guess / sig;
+	} while (fabs(old_guess - new_guess) > limit && i < 20);
+	*iterations = i;
+	return new_guess;
+}
+
+//
+// The strategies.  Each runs OPS_PER_SAMPLE operations (or one pass over the
+// array for the batch strategies) and returns the loop iterations per operation.
+//
+
+static int run_bisect(void)
+{
+	int iterations = 0;
+	for (int i=0; i<OPS_PER_SAMPLE; i++) {
+		sink = (double)sqrt_bisect(bench_value, &iterations);
+	}
+	return iterations;
+}
+
+static int run_newton(void)
+{
+	int iterations = 0;
+	for (int i=0; i<OPS_PER_SAMPLE; i++) {
+		sink = sqrt_newton_counted(bench_value, &iterations);
+	}
+	return iterations;
+}
+
+static int run_sqrt2(void)
+{
+	for (int i=0; i<OPS_PER_SAMPLE; i++) {
+		sink = sqrt2();
+	}
+	return -1;
+}
+
+static int run_hardware(void)
+{
+	for (int i=0; i<OPS_PER_SAMPLE; i++) {
+		sink = sqrt(bench_value);
+	}
+	return -1;
+}
+
+static int run_u128(void)
+{
+	for (int i=0; i<OPS_PER_SAMPLE; i++) {
+		sink = (double)sqrt_u128((uint64_t)bench_value, SQRT2_U128_DIGITS);
+	}
+	return -1;
+}
+
+static int run_newton_array(void)
+{
+	for (size_t i=0; i<batch_n; i++) {
+		batch_out[i] = sqrt_newton(batch_in[i]);
+	}
+	return -1;
+}
+
+static int run_hardware_array(void)
+{
+	for (size_t i=0; i<batch_n; i++) {
+		batch_out[i] = sqrt(batch_in[i]);
+	}
+	return -1;
+}
+
+static int run_batch(void)
+{
+	sqrt_batch(batch_in, batch_out, batch_n);
+	return -1;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Time a strategy.  It is run a number of times to warm up the caches and branch
+ * predictors, then the given number of samples are timed.
+ *
+ * Parameters:
+ *		in: name - the name to report
+ *		in: run - the strategy
+ *		in: ops - the number of operations one run of the strategy does
+ *		in: samples - the number of timed runs
+ *
+ * Returns:
+ *		The timing results
+ */
+static Result measure(const char *name, int (*run)(void), double ops, int samples)
+{
+	Result r = { name, 0, 0, 0, -1, samples };
+	double *times = (double *)malloc(samples * sizeof(double));
+	if (!times) {
+		fprintf(stderr, "Unable to allocate memory for %d samples\n", samples);
+		return r;
+	}
+
+	int warmup = samples < WARMUP_SAMPLES ? samples : WARMUP_SAMPLES;
+	for (int i=0; i<warmup; i++) {
+		run();
+	}
+
+	double total = 0;
+	for (int i=0; i<samples; i++) {
+		double start = now_ns();
+		r.iterations = run();
+		times[i] = (now_ns() - start) / ops;
+		total += times[i];
+	}
+
+	qsort(times, samples, sizeof(double), compare_doubles);
+	r.ns_per_op = total / samples;
+	r.p50 = times[samples / 2];
+	r.p99 = times[(int)(samples * 0.99)];
+	free(times);
+	return r;
+}
+
+/*
+ * Read a file containing one floating point value per line, such as the
+ * exercise07 DataFile.txt.
+ *
+ * Parameters:
+ * 		in: file_name - the name of the file to read
+ *		out: size - the number of values read
+ *
+ * Returns:
+ *		A pointer to an array of double values that must be freed by the caller,
+ *		or NULL if an error is encountered.
+ */
+static double *read_values(const char *file_name, size_t *size)
+{
+	FILE *fp = fopen(file_name, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "Unable to open %s for reading\n", file_name);
+		return NULL;
+	}
+
+	size_t num = 0, cap = 1024;
+	double *array = (double *)malloc(cap * sizeof(double));
+	char input[INPUT_SIZE];
+	while (array && fgets(input, INPUT_SIZE, fp) != NULL) {
+		if (num == cap) {
+			cap *= 2;
+			double *bigger = (double *)realloc(array, cap * sizeof(double));
+			if (!bigger) {
+				free(array);
+				array = NULL;
+				break;
+			}
+			array = bigger;
+		}
+		if (sscanf(input, "%lf", &array[num]) == 1) {
+			num++;
+		}
+	}
+	fclose(fp);
+
+	if (!array) {
+		fprintf(stderr, "Unable to allocate memory for the values in %s\n", file_name);
+		return NULL;
+	}
+	*size = num;
+	return array;
+}
+
+/*
+ * Time the square root strategies: the bisection search from exercise04, the
+ * Newton loop from exercise05, sqrt2(), the hardware square root and the exact
+ * 128-bit fixed point square root (to 38 digits), one value at
+ * a time; then sqrt_newton, the hardware square root and sqrt_batch over an array.
+ *
+ * Parameters:
+ *		-j - write the results as JSON instead of a table
+ *		-n samples - the number of timed samples for the single value strategies
+ *		file - optional, a file of values (one per line) for the array strategies.
+ *			   Without it, one million random values are used.
+ *
+ * Returns:
+ *		0 on success, else 1
+ */
+int main(int argc, char *argv[])
+{
+	bool json = false;
+	int samples = DEFAULT_SAMPLES;
+	const char *file_name = NULL;
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-j") == 0) {
+			json = true;
+		} else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atoi(argv[i+1]) > 0) {
+			samples = atoi(argv[++i]);
+		} else if (argv[i][0] != '-' && !file_name) {
+			file_name = argv[i];
+		} else {
+			fprintf(stderr, "Usage: %s [-j] [-n samples] [file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	size_t n = DEFAULT_COUNT;
+	double *in;
+	if (file_name) {
+		in = read_values(file_name, &n);
+	} else {
+		in = (double *)malloc(n * sizeof(double));
+		srand(1);
+		for (size_t i=0; in && i<n; i++) {
+			in[i] = (double)rand() / RAND_MAX * 1e6;
+		}
+	}
+	double *out = (double *)malloc((n ? n : 1) * sizeof(double));
+	if (!in || !out || n == 0) {
+		fprintf(stderr, "No values to take the square roots of\n");
+		free(in);
+		free(out);
+		return 1;
+	}
+	batch_in = in;
+	batch_out = out;
+	batch_n = n;
+
+	Result results[16];
+	int count = 0;
+	results[count++] = measure("bisection (exercise04)", run_bisect, OPS_PER_SAMPLE, samples);
+	results[count++] = measure("newton (exercise05)", run_newton, OPS_PER_SAMPLE, samples);
+	results[count++] = measure("sqrt2", run_sqrt2, OPS_PER_SAMPLE, samples);
+	results[count++] = measure("hardware sqrt", run_hardware, OPS_PER_SAMPLE, samples);
+	results[count++] = measure("u128 fixed point", run_u128, OPS_PER_SAMPLE, samples);
+	results[count++] = measure("sqrt_newton array", run_newton_array, n, BATCH_SAMPLES);
+	results[count++] = measure("hardware sqrt array", run_hardware_array, n, BATCH_SAMPLES);
+
+	const char *isa_names[] = { "sqrt_batch auto", "sqrt_batch scalar", "sqrt_batch AVX2", "sqrt_batch AVX-512" };
+	for (int isa=SQRT_ISA_AUTO; isa<=SQRT_ISA_AVX512; isa++) {
+		// sqrt_batch would quietly fall back to another instruction set
+		if (!sqrt_batch_isa_supported(isa)) {
+			continue;
+		}
+		sqrt_batch_isa = isa;
+		results[count++] = measure(isa_names[isa], run_batch, n, BATCH_SAMPLES);
+	}
+	sqrt_batch_isa = SQRT_ISA_AUTO;
+
+	if (json) {
+		printf("{\n  \"array_size\": %ld,\n  \"benchmarks\": [\n", (long) n);
+		for (int i=0; i<count; i++) {
+			printf("    {\"name\": \"%s\", \"ns_per_op\": %.4f, \"p50_ns\": %.4f, \"p99_ns\": %.4f, "
+					"\"iterations\": %d, \"samples\": %d}%s\n", results[i].name, results[i].ns_per_op,
+					results[i].p50, results[i].p99, results[i].iterations, results[i].samples,
+					i + 1 < count ? "," : "");
+		}
+		printf("  ]\n}\n");
+	} else {
+		printf("%-24s %12s %12s %12s %10s\n", "strategy", "ns/op", "p50 ns", "p99 ns", "iterations");
+		for (int i=0; i<count; i++) {
+			printf("%-24s %12.3f %12.3f %12.3f ", results[i].name, results[i].ns_per_op, results[i].p50, results[i].p99);
+			if (results[i].iterations >= 0)
+				printf("%10d\n", results[i].iterations);
+			else
+				printf("%10s\n", "-");
+		}
+		printf("(array strategies over %ld values)\n", (long) n);
+	}
+
+	free(in);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <bigsqrt.h>
+
+#define LIMB_BASE			10000	// each limb holds four decimal digits
+#define LIMB_DIGITS			4
+#define GUARD_LIMBS			5		// extra limbs carried to absorb truncation error (two of
+									// them for the value, which multiplies the error in y)
+#define CHECK_DIGITS		8		// digits past the last that show it may be wrong
+#define KARATSUBA_CUTOFF	32		// below this many limbs use the schoolbook multiply
+
+//
+// Numbers are stored as fixed-point arrays of limbs.  Limb 0 is the integer part
+// and limb i (i >= 1) has the weight LIMB_BASE^-i, so an array of p+1 limbs holds
+// 4*p digits after the decimal point.  Products are accumulated as polynomials with
+// 64-bit coefficients and the carries are only propagated once at the end, which
+// is what lets Karatsuba subtract partial products without borrowing.
+//
+
+/*
+ * Multiply two polynomials of n coefficients each using the schoolbook method.
+ *
+ * Parameters:
+ *		in: a, b - the coefficients to multiply
+ *		in: n - the number of coefficients in a and b
+ *		out: out - 2*n coefficients of the product
+ *
+ * Returns n/a
+ */
+static void mul_schoolbook(const uint64_t *a, const uint64_t *b, size_t n, uint64_t *out)
+{
+	memset(out, 0, 2 * n * sizeof(uint64_t));
+	for (size_t i=0; i<n; i++) {
+		uint64_t ai = a[i];
+		if (ai == 0) {
+			continue;
+		}
+		for (size_t j=0; j<n; j++) {
+			out[i+j] += ai * b[j];
+		}
+	}
+}
+
+/*
+ * Multiply two polynomials of n coefficients each using Karatsuba's method.
+ *
+ * Parameters:
+ *		in: a, b - the coefficients to multiply
+ *		in: n - the number of coefficients in a and b
+ *		out: out - 2*n coefficients of the product
+ *		in: scratch - work space of at least 4*n + 512 coefficients
+ *
+ * Returns n/a
+ */
+static void mul_karatsuba(const uint64_t *a, const uint64_t *b, size_t n, uint64_t *out, uint64_t *scratch)
+{
+	if (n <= KARATSUBA_CUTOFF) {
+		mul_schoolbook(a, b, n, out);
+		return;
+	}
+
+	size_t h = n / 2;		// size of the low halves
+	size_t m = n - h;		// size of the high halves (h or h+1)
+	uint64_t *sa = scratch;
+	uint64_t *sb = scratch + m;
+	uint64_t *z1 = scratch + 2 * m;
+	uint64_t *next = scratch + 4 * m;
+
+	mul_karatsuba(a, b, h, out, next);					// low * low
+	mul_karatsuba(a + h, b + h, m, out + 2 * h, next);	// high * high
+
+	for (size_t i=0; i<m; i++) {
+		sa[i] = a[h+i] + (i < h ? a[i] : 0);
+		sb[i] = b[h+i] + (i < h ? b[i] : 0);
+	}
+	mul_karatsuba(sa, sb, m, z1, next);
+
+	// the middle term is (low+high)*(low+high) - low*low - high*high
+	for (size_t i=0; i<2*h; i++) {
+		z1[i] -= out[i];
+	}
+	for (size_t i=0; i<2*m; i++) {
+		z1[i] -= out[2*h+i];
+	}
+	for (size_t i=0; i<2*m; i++) {
+		out[h+i] += z1[i];
+	}
+}
+
+/*
+ * Multiply two fixed-point numbers and truncate the product to p limbs after the
+ * decimal point.  Limb i of a has the weight LIMB_BASE^-(oa+i), and likewise for b,
+ * so a caller can skip over leading zero limbs.
+ *
+ * Parameters:
+ *		in: a, na, oa - the limbs of the first number, their count and offset
+ *		in: b, nb, ob - the limbs of the second number, their count and offset
+ *		out: r - p+1 limbs of the product
+ *		in: p - the number of limbs to keep after the decimal point
+ *
+ * Returns:
+ *		0 on success, else 1 (memory could not be allocated)
+ */
+static int mul_trunc(const uint32_t *a, size_t na, size_t oa, const uint32_t *b, size_t nb, size_t ob,
+		uint32_t *r, size_t p)
+{
+	size_t n = na > nb ? na : nb;
+	uint64_t *buf = (uint64_t *)malloc((8 * n + 512) * sizeof(uint64_t));
+	if (!buf) {
+		fprintf(stderr, "Unable to allocate memory for a %ld limb product\n", (long) n);
+		return 1;
+	}
+	uint64_t *fa = buf;
+	uint64_t *fb = buf + n;
+	uint64_t *prod = buf + 2 * n;
+	uint64_t *scratch = buf + 4 * n;
+
+	for (size_t i=0; i<n; i++) {
+		fa[i] = i < na ? a[i] : 0;
+		fb[i] = i < nb ? b[i] : 0;
+	}
+	mul_karatsuba(fa, fb, n, prod, scratch);
+
+	// propagate the carries from the least significant limb up to the integer part
+	memset(r, 0, (p + 1) * sizeof(uint32_t));
+	uint64_t carry = 0;
+	for (size_t idx = oa + ob + 2 * n; idx-- > 0; ) {
+		size_t k = idx - (oa + ob);
+		uint64_t v = carry + (idx >= oa + ob ? prod[k] : 0);
+		if (idx == 0) {
+			r[0] = (uint32_t)v;
+			break;
+		}
+		carry = v / LIMB_BASE;
+		if (idx <= p) {
+			r[idx] = (uint32_t)(v % LIMB_BASE);
+		}
+	}
+
+	free(buf);
+	return 0;
+}
+
+/*
+ * Multiply a fixed-point number of p limbs by a small integer.  r and a may be
+ * the same array.
+ */
+static void mul_small(uint32_t *r, const uint32_t *a, size_t p, uint32_t m)
+{
+	uint64_t carry = 0;
+	for (size_t i=p; i>0; i--) {
+		uint64_t v = (uint64_t)a[i] * m + carry;
+		r[i] = (uint32_t)(v % LIMB_BASE);
+		carry = v / LIMB_BASE;
+	}
+	r[0] = (uint32_t)((uint64_t)a[0] * m + carry);
+}
+
+/*
+ * Divide a fixed-point number of p limbs by two, in place.  The bit shifted out of
+ * the last limb is dropped.
+ */
+static void half(uint32_t *a, size_t p)
+{
+	uint32_t rem = 0;
+	for (size_t i=0; i<=p; i++) {
+		uint32_t v = a[i] + rem * LIMB_BASE;
+		a[i] = v / 2;
+		rem = v % 2;
+	}
+}
+
+/*
+ * Add (or subtract, if negate is set) the fixed-point number d to y, in place.  Both
+ * have p limbs after the decimal point.  y must be larger than d when subtracting.
+ */
+static void add_sub(uint32_t *y, const uint32_t *d, size_t p, int negate)
+{
+	int32_t carry = 0;
+	for (size_t i=p; i>0; i--) {
+		int32_t v = (int32_t)y[i] + (negate ? -(int32_t)d[i] : (int32_t)d[i]) + carry;
+		carry = 0;
+		if (v < 0) {
+			v += LIMB_BASE;
+			carry = -1;
+		} else if (v >= LIMB_BASE) {
+			v -= LIMB_BASE;
+			carry = 1;
+		}
+		y[i] = (uint32_t)v;
+	}
+	y[0] = (uint32_t)((int32_t)y[0] + (negate ? -(int32_t)d[0] : (int32_t)d[0]) + carry);
+}
+
+/*
+ * Square a fixed-point number of q limbs exactly and compare the square with an
+ * integer.
+ *
+ * Parameters:
+ *		in: r - q+1 limbs of the number to square
+ *		in: q - the number of limbs after the decimal point
+ *		in: value - the integer to compare with
+ *		out: sq - 2*q+1 limbs of work space
+ *		out: err - set to 1 if memory could not be allocated
+ *
+ * Returns:
+ *		1 if r^2 is greater than value, else 0
+ */
+static int square_exceeds(const uint32_t *r, size_t q, unsigned int value, uint32_t *sq, int *err)
+{
+	if (mul_trunc(r, q + 1, 0, r, q + 1, 0, sq, 2 * q)) {
+		*err = 1;
+		return 0;
+	}
+	if (sq[0] != value) {
+		return sq[0] > value;
+	}
+	for (size_t i=1; i<=2*q; i++) {
+		if (sq[i] != 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Calculate the square root of an integer to an arbitrary number of decimal places.
+ *
+ * Newton's method is run on the reciprocal square root, y' = y + y(1 - value*y^2)/2,
+ * which needs only multiplications.  Each iteration doubles the number of correct
+ * digits, so the working precision is doubled as well, starting from a double
+ * precision guess.  Multiplications use Karatsuba's method on base 10000 limbs so
+ * the digits never need to be converted from binary.  The square root is then
+ * value * y.  The error left in that is far smaller than one in the last digit,
+ * so truncating it can only give the wrong last digit when the digits after it are
+ * all zeros or all nines.  Then the last digit is fixed by squaring the result (and
+ * the next value up) exactly and stepping it until its square is no more than value
+ * and the next one's is more.
+ *
+ * Parameters:
+ *		in: value - the number to take the square root of (less than 100000000)
+ *		in: digits - the number of digits to compute after the decimal point
+ *					(at most BIG_SQRT_MAX_DIGITS)
+ *
+ * Returns:
+ *		A string containing the square root (e.g. "1.4142"), truncated (not rounded)
+ *		to the requested number of digits.  Memory for the string is allocated and
+ *		must be freed by the caller.  Returns NULL and prints a message to stderr on
+ *		error.
+ */
+char *big_sqrt(unsigned int value, size_t digits)
+{
+	if (value == 0 || value >= 100000000 || digits > BIG_SQRT_MAX_DIGITS) {
+		fprintf(stderr, "Unable to compute the square root of %u to %ld digits\n", value, (long) digits);
+		return NULL;
+	}
+
+	size_t prec = (digits + LIMB_DIGITS - 1) / LIMB_DIGITS + GUARD_LIMBS;
+
+	// Work out the precision for each Newton step, going backwards from the final
+	// precision.  Each step only needs a little more than half the limbs of the next.
+	size_t steps[64];
+	int num_steps = 0;
+	size_t p = prec;
+	while (p > 4) {
+		steps[num_steps++] = p;
+		p = p / 2 + 2;
+	}
+
+	uint32_t *y = (uint32_t *)calloc(4 * (prec + 1), sizeof(uint32_t));
+	if (!y) {
+		fprintf(stderr, "Unable to allocate memory for %ld digits\n", (long) digits);
+		return NULL;
+	}
+	uint32_t *t = y + (prec + 1);
+	uint32_t *e = t + (prec + 1);
+	uint32_t *d = e + (prec + 1);
+
+	// the starting guess comes from the hardware
+	double guess = 1.0 / sqrt((double)value);
+	for (size_t i=0; i<=p; i++) {
+		y[i] = (uint32_t)guess;
+		guess = (guess - y[i]) * LIMB_BASE;
+	}
+
+	int err = 0;
+	while (num_steps > 0 && !err) {
+		p = steps[--num_steps];
+
+		// t = value * y^2, which is close to one
+		err = mul_trunc(y, p + 1, 0, y, p + 1, 0, t, p);
+		if (err) {
+			break;
+		}
+		mul_small(t, t, p, value);
+
+		// e = |1 - t|
+		int negative = t[0] >= 1;
+		memcpy(e, t, (p + 1) * sizeof(uint32_t));
+		if (negative) {
+			e[0] -= 1;
+		} else {
+			memset(d, 0, (p + 1) * sizeof(uint32_t));
+			d[0] = 1;
+			add_sub(d, e, p, 1);
+			memcpy(e, d, (p + 1) * sizeof(uint32_t));
+		}
+
+		// The first half of e is zero (that's what the last step bought us), so only
+		// the leading limbs of y can reach the kept part of the product.
+		size_t h = 1;
+		while (h <= p && e[h] == 0) {
+			h++;
+		}
+		if (h > p) {
+			continue;	// y is exact
+		}
+		err = mul_trunc(y, p - h + 1, 0, e + h, p - h + 1, h, d, p);
+		half(d, p);
+		add_sub(y, d, p, negative);
+	}
+
+	// truncate value * y to the digits asked for, then make the last one exact
+	size_t q = (digits + LIMB_DIGITS - 1) / LIMB_DIGITS;
+	uint32_t unit = 1;			// one in the last digit, which is in limb q
+	for (size_t i=digits; i<q*LIMB_DIGITS; i++) {
+		unit *= 10;
+	}
+	uint32_t *sq = NULL;
+	int check = 0;
+	if (!err) {
+		mul_small(t, y, prec, value);
+		int zeros = 0, nines = 0;
+		for (size_t i=digits; i<digits+CHECK_DIGITS; i++) {
+			uint32_t digit = t[i / LIMB_DIGITS + 1];
+			for (size_t j=i%LIMB_DIGITS; j<LIMB_DIGITS-1; j++) {
+				digit /= 10;
+			}
+			zeros += digit % 10 == 0;
+			nines += digit % 10 == 9;
+		}
+		check = zeros == CHECK_DIGITS || nines == CHECK_DIGITS;
+		memset(t + q + 1, 0, (prec - q) * sizeof(uint32_t));
+		t[q] -= t[q] % unit;
+	}
+	if (check) {
+		memset(d, 0, (q + 1) * sizeof(uint32_t));
+		d[q] = unit;
+		sq = (uint32_t *)malloc((2 * q + 1) * sizeof(uint32_t));
+		if (!sq) {
+			fprintf(stderr, "Unable to allocate memory for %ld digits\n", (long) digits);
+			err = 1;
+		}
+	}
+	while (check && !err) {
+		if (square_exceeds(t, q, value, sq, &err)) {
+			add_sub(t, d, q, 1);
+			continue;
+		}
+		memcpy(e, t, (q + 1) * sizeof(uint32_t));
+		add_sub(e, d, q, 0);
+		if (err || square_exceeds(e, q, value, sq, &err)) {
+			break;
+		}
+		memcpy(t, e, (q + 1) * sizeof(uint32_t));
+	}
+	free(sq);
+
+	char *result = NULL;
+	if (!err) {
+
+		result = (char *)malloc(digits + 16);
+		if (!result) {
+			fprintf(stderr, "Unable to allocate %ld bytes for the result\n", (long) digits + 16);
+		} else {
+			char *s = result + sprintf(result, "%u", t[0]);
+			if (digits > 0) {
+				*(s++) = '.';
+			}
+			for (size_t i=1; digits > 0; i++) {
+				char limb[LIMB_DIGITS + 1];
+				size_t n = digits < LIMB_DIGITS ? digits : LIMB_DIGITS;
+				sprintf(limb, "%04u", t[i]);
+				memcpy(s, limb, n);
+				s += n;
+				digits -= n;
+			}
+			*s = '\0';
+		}
+	}
+
+	free(y);
+	return result;
+}
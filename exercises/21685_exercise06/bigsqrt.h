@@ -0,0 +1,12 @@
+#ifndef BIGSQRT_H
+#define BIGSQRT_H
+
+#include <stddef.h>
+
+// Largest number of digits big_sqrt will compute.  Above this the 64-bit
+// Karatsuba coefficients could overflow.
+#define BIG_SQRT_MAX_DIGITS	8000000
+
+char *big_sqrt(unsigned int value, size_t digits);
+
+#endif
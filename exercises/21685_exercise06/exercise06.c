@@ -4,36 +4,77 @@
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <time.h>		// needed for clock()
 
 #include <sqroot.h>
+#include <bigsqrt.h>
+#include <verify.h>
+#include <sqrtfamily.h>
+#include <spigot.h>
+#ifdef HAVE_FLOAT128
+#include <quadmath.h>
+#endif
 
 
 #define SQR2_FILE	"SquareRootTwo.txt"
+#define DISPLAY_DIGITS	1000	// longer answers are abbreviated when displayed
+#define TYPE_REPS		1000000	// calls timed for each type in report_types
+#define TYPE_CHECKS		100000	// random values each type's square root is checked on
 
 char *read_file(const char *file_name);
+int verify_files(const char *ref_name, const char *calc_name);
+int verify_files_parallel(const char *ref_name, const char *calc_name, int threads);
+int report_types(const char *check_number);
+int stream_digits(const char *ref_name);
 
 /*
  * Calculate the square root of 2, compare the result to a known value for the
  * square root of two, and display both.
  *
- * Parameters: n/a
+ * The square root is calculated to as many digits as the value from NASA has, or
+ * to the number of digits given on the command line if that is more.
+ *
+ * With -v, two files of digits are compared instead (see verify_files, or
+ * verify_files_parallel when -j gives a number of threads).  With -t,
+ * the square root of each numeric type is compared (see report_types).  With -s, the
+ * digits are produced and checked as a stream (see stream_digits).
+ *
+ * Parameters:
+ *		argv[1] - optional, the number of digits to compute after the decimal point,
+ *				  -v [-j threads] followed by the names of the two files to compare, -t, or -s
+ *				  optionally followed by the name of the reference file
  *
  * Returns:
  *		0 on success, else 1
  */
-
-
-int main(void)
+int main(int argc, char *argv[])
 {
-    clock_t start, stop, elapsed;
-    start = clock();
-    double new_guess = sqrt2();
-    stop = clock();
-    elapsed = (double)(stop-start);
+	clock_t start, stop;
+	double elapsed;
+
+	if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+		if (argc == 6 && strcmp(argv[2], "-j") == 0) {
+			return verify_files_parallel(argv[4], argv[5], atoi(argv[3]));
+		}
+		if (argc != 4) {
+			fprintf(stderr, "Usage: %s -v [-j threads] reference_file computed_file\n", argv[0]);
+			return 1;
+		}
+		return verify_files(argv[2], argv[3]);
+	}
+	if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+		return stream_digits(argc > 2 ? argv[2] : SQR2_FILE);
+	}
 
-	// Display the calculated square root
-	printf("\nThe square root of two is: %lf\n", new_guess);
+	// Display the square root that fits in a double, for comparison
+	printf("\nThe square root of two (double) is: %lf\n", sqrt2());
 
 	// Read in the square root that NASA has computed from a file
 	// read_file allocates memory for check_number, so we will
@@ -44,47 +85,395 @@ int main(void)
 		return 1;
 	}
 
-	int bufsize = strlen(check_number) + 1;	// plus the null character
-	char *answer_buf = (char *)malloc((size_t)bufsize);
+	if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+		int result = report_types(check_number);
+		free(check_number);
+		return result;
+	}
+
+	// the number of digits after the decimal point in the data from NASA, which is
+	// assumed to be the length less the "1."
+	size_t digits = strlen(check_number) - 2;
+	if (argc > 1) {
+		char *end;
+		unsigned long requested = strtoul(argv[1], &end, 10);
+		if (*end != '\0' || requested > BIG_SQRT_MAX_DIGITS) {
+			fprintf(stderr, "Usage: %s [digits]  (at most %d digits)\n", argv[0], BIG_SQRT_MAX_DIGITS);
+			free(check_number);
+			return 1;
+		}
+		if (requested > digits) {
+			digits = requested;
+		}
+	}
+
+	start = clock();
+	char *answer_buf = big_sqrt(2, digits);
+	stop = clock();
+	elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
 	if (!answer_buf) {
-		fprintf(stderr, "Unable to allocate %d bytes for answer\n", bufsize);
+		// error message already printed
 		free(check_number);
 		return 1;
 	}
 
-	// convert the answer from a double to a string
-	// the precision (number of digits after the decimal point) is the number
-	// of digits after the decimal point in the data from NASA, which is
-	// assumed to be bufsize-2
-	sprintf(answer_buf, "%.*lf", bufsize-2, new_guess);
-
 	// Compare the two strings.  Can't use strcmp here because we want to know
 	// at what character the strings differ.
-	char *a = answer_buf;
-	char *c = check_number;
-	int i = 0;
-	while(*a != '\0' && *c != '\0') {
-		if (*a != *c) {
-			break;
-		}
-		i++; a++; c++;
-	}
+	size_t check_len = strlen(check_number);
+	size_t answer_len = strlen(answer_buf);
+	size_t i = first_mismatch(answer_buf, check_number, answer_len < check_len ? answer_len : check_len);
+	bool identical = i == check_len;
 
 	// Display the results
 	printf("\nThe value from NASA is:\n%s\n", check_number);
-	printf("The value we computed is:\n%s\n", answer_buf);
+	if (digits <= DISPLAY_DIGITS)
+		printf("The value we computed is:\n%s\n", answer_buf);
+	else
+		printf("The value we computed is:\n%.*s... (%ld digits)\n", DISPLAY_DIGITS + 2, answer_buf, (long) digits);
+
+	if (identical)
+		printf("The numbers are identical to %ld significant digits.\n", (long) i);
+	else
+		printf("The numbers differ at position %ld.\n", (long) i+1);
 
-	if (i == bufsize)
-		printf("The numbers are identical to %d significant digits.\n", i);
+	// The first digits can be had exactly with 128-bit integer arithmetic
+	char fixed_buf[64];
+	fixed128_to_string(sqrt_u128(2, SQRT2_U128_DIGITS), SQRT2_U128_DIGITS, fixed_buf);
+	size_t fixed_len = strlen(fixed_buf);
+	size_t fixed_match = first_mismatch(fixed_buf, check_number, fixed_len < check_len ? fixed_len : check_len);
+	printf("\nThe 128-bit fixed point value is:\n%s\n", fixed_buf);
+	if (fixed_match == fixed_len)
+		printf("It is an exact match for the first %ld significant digits.\n", (long) fixed_match);
 	else
-		printf("The numbers differ at position %d.\n", i+1);
+		printf("It differs at position %ld.\n", (long) fixed_match + 1);
 
-	printf("Elapsed time: %lf ms\n", elapsed);
+	printf("Computed %ld digits in %.3f ms", (long) digits, elapsed);
+	if (elapsed > 0)
+		printf(" (%.0f digits per second)", digits / (elapsed / 1000.0));
+	printf("\n");
 
 	// free the memory we used
 	free(check_number);
 	free(answer_buf);
 
+	return identical ? 0 : 1;
+}
+
+/*
+ * Compare two files of digits, such as a reference constant and a computed one,
+ * and display the position of the first difference.  The files are streamed in
+ * blocks, so they can be far larger than memory.
+ *
+ * Parameters:
+ *		in: ref_name - the name of the file with the reference digits
+ *		in: calc_name - the name of the file with the computed digits
+ *
+ * Returns:
+ *		0 if the files are the same (up to the end of the shorter), else 1
+ */
+int verify_files(const char *ref_name, const char *calc_name)
+{
+	FILE *ref = fopen(ref_name, "r");
+	if (ref == NULL) {
+		fprintf(stderr, "Unable to open %s for reading\n", ref_name);
+		return 1;
+	}
+	FILE *calc = fopen(calc_name, "r");
+	if (calc == NULL) {
+		fprintf(stderr, "Unable to open %s for reading\n", calc_name);
+		fclose(ref);
+		return 1;
+	}
+
+	size_t matched;
+	clock_t start = clock();
+	bool same = verify_stream(file_digits, ref, file_digits, calc, &matched);
+	double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	if (same)
+		printf("The numbers are identical to %ld significant digits.\n", (long) matched);
+	else
+		printf("The numbers differ at position %ld.\n", (long) matched + 1);
+	if (elapsed > 0)
+		printf("Verified %ld digits in %.3f s (%.1f MB/s)\n", (long) matched, elapsed, matched / elapsed / 1e6);
+
+	fclose(ref);
+	fclose(calc);
+	return same ? 0 : 1;
+}
+
+/*
+ * Compare two files of digits using several threads.  Both files are read into
+ * memory with read_file and the digits are compared by first_mismatch_parallel.
+ *
+ * Parameters:
+ *		in: ref_name - the name of the file with the reference digits
+ *		in: calc_name - the name of the file with the computed digits
+ *		in: threads - the number of threads to use, 0 for one per processor
+ *
+ * Returns:
+ *		0 if the files are the same (up to the end of the shorter), else 1
+ */
+int verify_files_parallel(const char *ref_name, const char *calc_name, int threads)
+{
+	if (threads <= 0) {
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+
+	char *check_number = read_file(ref_name);
+	if (!check_number) {
+		return 1;
+	}
+	char *answer_buf = read_file(calc_name);
+	if (!answer_buf) {
+		free(check_number);
+		return 1;
+	}
+
+	size_t check_len = strlen(check_number);
+	size_t answer_len = strlen(answer_buf);
+	size_t n = answer_len < check_len ? answer_len : check_len;
+	if (n == 0) {
+		// as in verify_stream, an empty file matches nothing
+		fprintf(stderr, "Unable to read any digits from %s\n", check_len == 0 ? ref_name : calc_name);
+		free(check_number);
+		free(answer_buf);
+		return 1;
+	}
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	size_t i = first_mismatch_parallel(answer_buf, check_number, n, threads);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (i == n)
+		printf("The numbers are identical to %ld significant digits.\n", (long) i);
+	else
+		printf("The numbers differ at position %ld.\n", (long) i + 1);
+	if (elapsed > 0)
+		printf("Compared %ld digits with %d threads in %.3f ms (%.1f MB/s)\n",
+				(long) i, threads, elapsed * 1000, i / elapsed / 1e6);
+
+	free(check_number);
+	free(answer_buf);
+	return i == n ? 0 : 1;
+}
+
+// the context of timed_spigot
+typedef struct timed_spigot_struct {
+	Spigot *spigot;
+	clock_t start;
+	clock_t first;		// when the first digits were produced, 0 until then
+} TimedSpigot;
+
+/*
+ * A digit_source that passes the digits of a Spigot through and notes when the
+ * first ones came out.
+ *
+ * Parameters:
+ *		in: ctx - the TimedSpigot (passed as void * to match digit_source)
+ *		out: buf - space for the digits
+ *		in: len - the size of buf
+ *
+ * Returns:
+ *		The number of digits stored in buf.
+ */
+static size_t timed_spigot(void *ctx, char *buf, size_t len)
+{
+	TimedSpigot *ts = (TimedSpigot *)ctx;
+	size_t n = spigot_digits(ts->spigot, buf, len);
+	if (ts->first == 0) {
+		ts->first = clock();
+	}
+	return n;
+}
+
+/*
+ * Produce the square root of two digit by digit and compare each chunk against a
+ * reference file as soon as it is produced, stopping at the first difference or
+ * at the end of the reference.  Nothing is held for the whole answer, so the
+ * first digits arrive straight away however long the reference is.
+ *
+ * Parameters:
+ *		in: ref_name - the name of the file with the reference digits
+ *
+ * Returns:
+ *		0 if all the digits in the reference were produced, else 1
+ */
+int stream_digits(const char *ref_name)
+{
+	FILE *ref = fopen(ref_name, "r");
+	if (ref == NULL) {
+		fprintf(stderr, "Unable to open %s for reading\n", ref_name);
+		return 1;
+	}
+	TimedSpigot ts = { spigot_new(2), 0, 0 };
+	if (!ts.spigot) {
+		fclose(ref);
+		return 1;
+	}
+
+	size_t matched;
+	ts.start = clock();
+	bool same = verify_stream(file_digits, ref, timed_spigot, &ts, &matched);
+	double elapsed = (double)(clock() - ts.start) * 1000.0 / CLOCKS_PER_SEC;
+
+	if (same)
+		printf("The numbers are identical to %ld significant digits.\n", (long) matched);
+	else
+		printf("The numbers differ at position %ld.\n", (long) matched + 1);
+	printf("First digits after %.3f ms, %ld digits in %.3f ms\n",
+			(double)(ts.first - ts.start) * 1000.0 / CLOCKS_PER_SEC,
+			(long) ts.spigot->produced, elapsed);
+	printf("Peak memory %ld bytes of digits plus %d bytes of buffers\n",
+			(long) spigot_memory(ts.spigot), 2 * VERIFY_BLOCK_SIZE);
+
+	spigot_free(ts.spigot);
+	fclose(ref);
+	return same ? 0 : 1;
+}
+
+/*
+ * Check a typed square root on random values against the C library's, which is
+ * correctly rounded.  libquadmath's sqrtq is not always, so __float128 is checked
+ * on long double values against sqrtl, and the fixed-point root is checked to be
+ * the largest whose square is not more than x.
+ *
+ * Parameters:
+ *		in: type - the type, numbered as in report_types
+ *
+ * Returns:
+ *		The number of values the square root was wrong for
+ */
+static long check_type(int type)
+{
+	uint64_t state = 88172645463325252ull;
+	long wrong = 0;
+	for (int i=0; i<TYPE_CHECKS; i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		// a 64-bit mantissa and an exponent from -64 to 63
+		long double x = ldexpl((long double)(state | (UINT64_C(1) << 63)), (int)(state >> 58) - 128);
+		switch (type) {
+			case 0:
+				wrong += sqrt_float((float)x) != sqrtf((float)x);
+				break;
+			case 1:
+				wrong += sqrt_double((double)x) != sqrt((double)x);
+				break;
+			case 2:
+				wrong += sqrt_long_double(x) != sqrtl(x);
+				break;
+#ifdef HAVE_FLOAT128
+			case 3:
+				// rounding the 113-bit root to 64 bits could only differ from sqrtl
+				// for a root within 2^-113 of halfway between two long doubles
+				wrong += (long double)sqrt_float128((__float128)x) != sqrtl(x);
+				break;
+#endif
+			case 4: {
+				fixed_t fx = (fixed_t)state;
+				unsigned __int128 n = (unsigned __int128)fx << FIXED_FRAC_BITS;
+				unsigned __int128 y = sqrt_fixed(fx);
+				wrong += y * y > n || (y + 1) * (y + 1) <= n;
+				break;
+			}
+		}
+	}
+	return wrong;
+}
+
+/*
+ * Display how many digits of the square root of two each numeric type gets right,
+ * how long it takes, and on how many random values it differs from the C library.
+ *
+ * Parameters:
+ *		in: check_number - the square root of two from NASA
+ *
+ * Returns:
+ *		0 on success, else 1
+ */
+int report_types(const char *check_number)
+{
+	size_t digits = strlen(check_number) - 2;
+	char *answer_buf = (char *)malloc(digits + 64);
+	if (!answer_buf) {
+		fprintf(stderr, "Unable to allocate %ld bytes for answer\n", (long) digits + 64);
+		return 1;
+	}
+
+	printf("\n%-12s %6s %8s %10s %12s\n", "type", "steps", "digits", "ns/call", "wrong");
+	for (int type=0; type<5; type++) {
+		const char *name = "";
+		int steps = 0;
+		volatile float f = 2;		// volatile so each call is really made
+		volatile double d = 2;
+		volatile long double ld = 2;
+		volatile fixed_t x = 2 * FIXED_ONE;
+		clock_t start = clock();
+		switch (type) {
+			case 0:
+				name = "float";
+				steps = SQRT_STEPS(FLT_MANT_DIG);
+				for (int i=0; i<TYPE_REPS; i++)
+					f = sqrt_typed(f * 0 + 2);
+				sprintf(answer_buf, "%.*f", (int) digits, (double) f);
+				break;
+			case 1:
+				name = "double";
+				steps = SQRT_STEPS(DBL_MANT_DIG);
+				for (int i=0; i<TYPE_REPS; i++)
+					d = sqrt_typed(d * 0 + 2);
+				sprintf(answer_buf, "%.*f", (int) digits, d);
+				break;
+			case 2:
+				name = "long double";
+				steps = SQRT_STEPS(LDBL_MANT_DIG);
+				for (int i=0; i<TYPE_REPS; i++)
+					ld = sqrt_typed(ld * 0 + 2);
+				sprintf(answer_buf, "%.*Lf", (int) digits, ld);
+				break;
+			case 3:
+#ifdef HAVE_FLOAT128
+				name = "__float128";
+				steps = SQRT_STEPS(FLOAT128_MANT_DIG);
+				__float128 q = 2;
+				for (int i=0; i<TYPE_REPS; i++)
+					q = sqrt_typed(q * (__float128)(d * 0) + 2);
+				quadmath_snprintf(answer_buf, digits + 64, "%.*Qf", (int) digits, q);
+				break;
+#else
+				continue;
+#endif
+			case 4: {
+				name = "fixed 32.32";
+				steps = FIXED_SQRT_STEPS;
+				for (int i=0; i<TYPE_REPS; i++)
+					x = sqrt_typed((fixed_t)(x * 0 + 2 * FIXED_ONE));
+				// write out the exact binary fraction, one decimal digit at a time
+				fixed_t frac = x & (FIXED_ONE - 1);
+				char *p = answer_buf + sprintf(answer_buf, "%lu.", (unsigned long)(x >> FIXED_FRAC_BITS));
+				for (size_t i=0; i<digits; i++) {
+					frac *= 10;
+					*(p++) = (char)('0' + (frac >> FIXED_FRAC_BITS));
+					frac &= FIXED_ONE - 1;
+				}
+				*p = '\0';
+				break;
+			}
+		}
+		double ns = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / TYPE_REPS;
+
+		// count the matching digits, not counting the decimal point
+		size_t len = strlen(answer_buf);
+		size_t i = first_mismatch(answer_buf, check_number, len < digits + 2 ? len : digits + 2);
+		printf("%-12s %6d %8ld %10.2f %5ld/%ld\n", name, steps, (long) (i > 1 ? i - 1 : i), ns,
+				check_type(type), (long) TYPE_CHECKS);
+	}
+
+	free(answer_buf);
 	return 0;
 }
 
@@ -96,6 +485,10 @@ int main(void)
  * present.  (The input file is expected to contain a decimal number, possibly with leading
  * and/or trailing spaces and embedded newlines).
  *
+ * The file is memory mapped and filtered in a single pass.  Runs of 16 digits are found
+ * with vector compares and copied to the string as a block; only blocks containing other
+ * characters are looked at one character at a time.
+ *
  * Parameters:
  * 		in: file_name - the name of the file to read
  *
@@ -105,62 +498,89 @@ int main(void)
  */
 char *read_file(const char *file_name)
 {
-	// open the file for reading
-	FILE *fp = fopen(file_name, "r");
-	if (fp == NULL) {
+	// open the file for reading and find out how big it is
+	int fd = open(file_name, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
 		fprintf(stderr, "Unable to open %s for reading\n", file_name);
+		if (fd >= 0)
+			close(fd);
 		return NULL;
 	}
-
-	// determine the size of the file by reading each character one by one until we get
-	// to end of file, then rewinding the file pointer back to the beginning
-	size_t size = 0;
-	while(fgetc(fp) != EOF) {
-		size++;
-	}
-	rewind(fp);
-
-	size ++;	// add one for the null byte on the end
+	size_t size = (size_t)st.st_size;
 
 	// allocate space for the contents of the file, include space for the null at the end
 	// of the string
-	char *buf = (char *)malloc(size);
+	char *buf = (char *)malloc(size + 1);
 	if(!buf) {
-		fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) size);
+		fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) size + 1);
+		close(fd);
 		return NULL;
 	}
 
-	// Read the file one character at a time and store the characters in
-	// the buffer.  Skip newlines. In fact, skip all characters that are not digits.
-	// Allow one decimal point.  This has the side effect of validing that the input
-	// file actually contains a float number.
+	// map the file into memory.  The mapping stays valid after the file is closed.
+	const char *data = NULL;
+	if (size > 0) {
+		data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			fprintf(stderr, "Unable to read %s\n", file_name);
+			free(buf);
+			close(fd);
+			return NULL;
+		}
+		madvise((void *)data, size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	// Go through the file and store the characters in the buffer.  Skip newlines.
+	// In fact, skip all characters that are not digits. Allow one decimal point.  This
+	// has the side effect of validing that the input file actually contains a float number.
 	bool have_decimal = false;
-	int i;
+	size_t i = 0;
 	char *p = buf;
-	for (i=0; i<size; i++) {
-		char c = (char)fgetc(fp);
-		if (c == '.') {
-			if(have_decimal) {
-				// found more than one decimal point
-				fprintf(stderr, "Input from %s is not a valid float in decimal format\n", file_name);
-				free(buf);
-				fclose(fp);
-				return NULL;
+	while (i < size) {
+#ifdef __SSE2__
+		if (i + 16 <= size) {
+			// a byte is a digit if byte - '0' is less than 10 (as an unsigned value)
+			__m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+			__m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+			__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+			if (_mm_movemask_epi8(is_digit) == 0xffff) {
+				_mm_storeu_si128((__m128i *)p, v);		// all digits - save them all
+				p += 16;
+				i += 16;
+				continue;
+			}
+		}
+#endif
+		// the rest of the block is done one character at a time
+		size_t end = i + 16 < size ? i + 16 : size;
+		for (; i<end; i++) {
+			char c = data[i];
+			if (c == '.') {
+				if(have_decimal) {
+					// found more than one decimal point
+					fprintf(stderr, "Input from %s is not a valid float in decimal format\n", file_name);
+					free(buf);
+					munmap((void *)data, size);
+					return NULL;
+				}
+				have_decimal = true;
+				*(p++) = c;		// save the decimal point
+			} else if (c >= '0' && c <= '9') {
+				*(p++) = c;		// save the digit
 			}
-			have_decimal = true;
-			*(p++) = c;		// save the decimal point
-		} else if (isdigit(c)) {
-			*(p++) = c;		// save the digit
+			// else do nothing - do not save the character
 		}
-		// else do nothing - do not save the character
 	}
 
 	// null-terminate the buffer (so that it becomes a string)
 	*p = '\0';
 
-	// close the input file
-	fclose(fp);
+	// done with the file
+	if (size > 0)
+		munmap((void *)data, size);
 
 	// return the data from the file as a null-terminated string
-    return buf;
+	return buf;
 }
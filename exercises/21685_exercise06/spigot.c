@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <spigot.h>
+
+#define NAT_BASE	1000000000u		// each limb holds nine decimal digits
+
+/*
+ * Make room for at least n limbs, growing geometrically.
+ *
+ * Returns:
+ *		0 on success, else 1 (memory could not be allocated)
+ */
+static int nat_reserve(BigNat *a, size_t n)
+{
+	if (n <= a->cap) {
+		return 0;
+	}
+	size_t cap = a->cap ? a->cap : 16;
+	while (cap < n) {
+		cap *= 2;
+	}
+	uint32_t *limb = (uint32_t *)realloc(a->limb, cap * sizeof(uint32_t));
+	if (!limb) {
+		fprintf(stderr, "Unable to allocate %ld bytes for the square root digits\n", (long) (cap * sizeof(uint32_t)));
+		return 1;
+	}
+	a->limb = limb;
+	a->cap = cap;
+	return 0;
+}
+
+static int nat_set(BigNat *a, uint64_t v)
+{
+	if (nat_reserve(a, 3)) {
+		return 1;
+	}
+	a->size = 0;
+	while (v > 0) {
+		a->limb[a->size++] = (uint32_t)(v % NAT_BASE);
+		v /= NAT_BASE;
+	}
+	return 0;
+}
+
+/*
+ * a = a * m + add, with m and add less than NAT_BASE.
+ */
+static int nat_mul_add(BigNat *a, uint32_t m, uint32_t add)
+{
+	uint64_t carry = add;
+	for (size_t i=0; i<a->size; i++) {
+		uint64_t v = (uint64_t)a->limb[i] * m + carry;
+		a->limb[i] = (uint32_t)(v % NAT_BASE);
+		carry = v / NAT_BASE;
+	}
+	while (carry > 0) {
+		if (nat_reserve(a, a->size + 1)) {
+			return 1;
+		}
+		a->limb[a->size++] = (uint32_t)(carry % NAT_BASE);
+		carry /= NAT_BASE;
+	}
+	return 0;
+}
+
+/*
+ * r = (a + add) * m, with add and m less than 10.
+ */
+static int nat_add_mul(BigNat *r, const BigNat *a, uint32_t add, uint32_t m)
+{
+	if (nat_reserve(r, a->size + 2)) {
+		return 1;
+	}
+	uint64_t carry = (uint64_t)add * m;
+	r->size = a->size;
+	for (size_t i=0; i<a->size; i++) {
+		uint64_t v = (uint64_t)a->limb[i] * m + carry;
+		r->limb[i] = (uint32_t)(v % NAT_BASE);
+		carry = v / NAT_BASE;
+	}
+	while (carry > 0) {
+		r->limb[r->size++] = (uint32_t)(carry % NAT_BASE);
+		carry /= NAT_BASE;
+	}
+	while (r->size > 0 && r->limb[r->size - 1] == 0) {
+		r->size--;
+	}
+	return 0;
+}
+
+static int nat_cmp(const BigNat *a, const BigNat *b)
+{
+	if (a->size != b->size) {
+		return a->size < b->size ? -1 : 1;
+	}
+	for (size_t i=a->size; i>0; i--) {
+		if (a->limb[i-1] != b->limb[i-1]) {
+			return a->limb[i-1] < b->limb[i-1] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * a = a - b, where a >= b.
+ */
+static void nat_sub(BigNat *a, const BigNat *b)
+{
+	int64_t borrow = 0;
+	for (size_t i=0; i<a->size; i++) {
+		int64_t v = (int64_t)a->limb[i] - (i < b->size ? b->limb[i] : 0) - borrow;
+		borrow = v < 0;
+		a->limb[i] = (uint32_t)(v < 0 ? v + NAT_BASE : v);
+	}
+	while (a->size > 0 && a->limb[a->size - 1] == 0) {
+		a->size--;
+	}
+}
+
+/*
+ * The value of a divided by NAT_BASE^(top - 3), from its three leading limbs.
+ * Two numbers approximated with the same top can be divided to estimate their
+ * ratio.
+ */
+static double nat_approx(const BigNat *a, size_t top)
+{
+	double v = 0;
+	for (size_t i=top; i>0 && i+3>top; i--) {
+		v = v * NAT_BASE + (i - 1 < a->size ? a->limb[i-1] : 0);
+	}
+	return v;
+}
+
+/*
+ * Produce the next digit of the square root with the long-hand method: bring down
+ * the next pair of digits (always 00 after the decimal point) and find the largest
+ * digit x with (20*root + x) * x no more than the remainder.
+ *
+ * Returns:
+ *		The digit, or -1 if memory could not be allocated
+ */
+static int next_digit(Spigot *sp)
+{
+	if (nat_mul_add(&sp->rem, 100, 0)) {
+		return -1;
+	}
+
+	// estimate x from the leading limbs, then correct it downwards if needed
+	size_t top = sp->rem.size > sp->twenty_root.size ? sp->rem.size : sp->twenty_root.size;
+	double r = nat_approx(&sp->rem, top);
+	double q = nat_approx(&sp->twenty_root, top);
+	int x = 9;
+	if (q > 0 && r / q < 9) {
+		x = (int)(r / q * (1 + 1e-9));
+	}
+	for (;;) {
+		if (nat_add_mul(&sp->trial, &sp->twenty_root, (uint32_t)x, (uint32_t)x)) {
+			return -1;
+		}
+		if (nat_cmp(&sp->trial, &sp->rem) <= 0) {
+			break;
+		}
+		x--;
+	}
+	nat_sub(&sp->rem, &sp->trial);
+
+	// 20 * (10*root + x) = 10 * (20*root) + 20x
+	if (nat_mul_add(&sp->twenty_root, 10, 20 * (uint32_t)x)) {
+		return -1;
+	}
+	return x;
+}
+
+/*
+ * Start producing the digits of a square root.
+ *
+ * Parameters:
+ *		in: value - the number to find the square root of
+ *
+ * Returns:
+ *		The spigot, which must be freed with spigot_free, or NULL if memory could
+ *		not be allocated
+ */
+Spigot *spigot_new(unsigned int value)
+{
+	Spigot *sp = (Spigot *)calloc(1, sizeof(Spigot));
+	if (!sp) {
+		fprintf(stderr, "Unable to allocate memory for the square root spigot\n");
+		return NULL;
+	}
+
+	// the integer part comes from the hardware, corrected to be exact
+	uint64_t root = (uint64_t)sqrt((double)value);
+	while (root * root > value) {
+		root--;
+	}
+	while ((root + 1) * (root + 1) <= value) {
+		root++;
+	}
+
+	sp->value = value;
+	sp->prefix_len = (size_t)sprintf(sp->prefix, "%lu.", (unsigned long) root);
+	if (nat_set(&sp->rem, value - root * root) || nat_set(&sp->twenty_root, 20 * root)) {
+		spigot_free(sp);
+		return NULL;
+	}
+	return sp;
+}
+
+/*
+ * A digit_source (see verify.h) that hands out the square root one chunk at a
+ * time, starting with the integer part and the decimal point.  At most SPIGOT_CHUNK
+ * digits are produced per call, so a caller comparing the digits sees the first
+ * ones straight away, whatever it asks for.
+ *
+ * Parameters:
+ *		in: spigot - the Spigot (passed as void * to match digit_source)
+ *		out: buf - space for the digits
+ *		in: len - the size of buf
+ *
+ * Returns:
+ *		The number of characters stored in buf, 0 if memory ran out.
+ */
+size_t spigot_digits(void *spigot, char *buf, size_t len)
+{
+	Spigot *sp = (Spigot *)spigot;
+	size_t n = 0;
+	while (n < len && sp->prefix_pos < sp->prefix_len) {
+		buf[n++] = sp->prefix[sp->prefix_pos++];
+	}
+
+	size_t chunk = len < SPIGOT_CHUNK ? len : SPIGOT_CHUNK;
+	while (n < chunk) {
+		int x = next_digit(sp);
+		if (x < 0) {
+			break;
+		}
+		buf[n++] = (char)('0' + x);
+		sp->produced++;
+	}
+	return n;
+}
+
+/*
+ * The number of bytes of memory held by a spigot.  This grows with the number of
+ * digits produced so far (a few bytes per digit), not with how many are wanted.
+ */
+size_t spigot_memory(const Spigot *sp)
+{
+	return sizeof(Spigot) + (sp->rem.cap + sp->twenty_root.cap + sp->trial.cap) * sizeof(uint32_t);
+}
+
+void spigot_free(Spigot *sp)
+{
+	if (sp) {
+		free(sp->rem.limb);
+		free(sp->twenty_root.limb);
+		free(sp->trial.limb);
+		free(sp);
+	}
+}
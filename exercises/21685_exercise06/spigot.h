@@ -0,0 +1,33 @@
+#ifndef SPIGOT_H
+#define SPIGOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPIGOT_CHUNK	64		// most digits produced by one call to spigot_digits
+
+// a natural number stored as base 10^9 limbs, least significant first
+typedef struct bignat_struct {
+	uint32_t *limb;
+	size_t size;		// limbs in use
+	size_t cap;			// limbs allocated
+} BigNat;
+
+// state of a square root being produced one digit at a time
+typedef struct spigot_struct {
+	unsigned int value;		// the number whose square root is being produced
+	BigNat rem;				// what is left of the number after subtracting root^2
+	BigNat twenty_root;		// 20 times the digits of the root produced so far
+	BigNat trial;			// scratch space for (20*root + x) * x
+	char prefix[16];		// integer part and decimal point, not yet handed out
+	size_t prefix_len;
+	size_t prefix_pos;
+	size_t produced;		// digits after the decimal point produced so far
+} Spigot;
+
+Spigot *spigot_new(unsigned int value);
+size_t spigot_digits(void *spigot, char *buf, size_t len);
+size_t spigot_memory(const Spigot *sp);
+void spigot_free(Spigot *sp);
+
+#endif
@@ -0,0 +1,413 @@
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86	1
+#endif
+
+#include <sqroot.h>
+
+// Magic constant for the bit-level reciprocal square root estimate of a double.
+// The estimate has a relative error of about 3.4%, roughly 4.8 correct bits.
+#define RSQRT_MAGIC		0x5fe6eb50c7b537a9ULL
+
+// Newton steps needed for full double precision from each starting estimate
+#define STEPS_MAGIC		4		// 4.8 bits -> 77 bits
+#define STEPS_RSQRT14	2		// 14 bits (AVX-512 vrsqrt14pd) -> 56 bits
+
+// a 256-bit unsigned integer, least significant word first
+typedef struct u256_struct {
+	uint64_t w[4];
+} U256;
+
+int sqrt_batch_steps = -1;
+int sqrt_batch_isa = SQRT_ISA_AUTO;
+
+/*
+ * Calculate the square root of 2 using Newton's method.
+ *
+ * Parameters: n/a
+ *
+ * Returns:
+ *		The square root of two as a double
+ */
+double sqrt2()
+{
+	return sqrt_newton(2);
+}
+
+/*
+ * Calculate the square root of a number using Newton's method.  This is the same
+ * loop as the exercise05 baseline: iterate until two successive guesses agree to a
+ * relative limit, or until 20 iterations have been done.
+ *
+ * Parameters:
+ *		in: value - the number to find the square root of
+ *
+ * Returns:
+ *		The square root of value as a double
+ */
+double sqrt_newton(double value)
+{
+	double sig = 1E+10;				// Used to establish the limit for ending the loop
+	double old_guess = value / 2;	// This is the initial guess
+	double new_guess = old_guess;	// set up the new_guess to be the same as the guess
+	double limit;					// The limit that determines the end of the loop
+	int i = 0;						// Loop iteration counter
+
+	do {
+		i++;
+		old_guess = new_guess;
+		new_guess = (old_guess + value / old_guess) / 2.0;
+		limit = new_guess / sig;
+	} while (fabs(old_guess - new_guess) > limit && i < 20);
+
+	return new_guess;
+}
+
+/*
+ * Square root of one value, the way the vector versions below do it for each lane:
+ * estimate 1/sqrt(x) from the bits of x, refine it with Newton's method
+ * y' = y(1.5 - 0.5xy^2), then make one correction of the square root itself using
+ * the residual x - s^2.  Values that are not positive normal numbers are left to
+ * the library.
+ */
+static double sqrt_one(double x, int steps)
+{
+	if (!(x >= 0x1p-1022 && x <= 0x1.fffffffffffffp+1023)) {
+		return sqrt(x);
+	}
+
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	bits = RSQRT_MAGIC - (bits >> 1);
+	double y;
+	memcpy(&y, &bits, sizeof(y));
+
+	double hx = 0.5 * x;
+	for (int i=0; i<steps; i++) {
+		y = y * (1.5 - hx * y * y);
+	}
+
+	double s = x * y;
+	return s + 0.5 * y * fma(-s, s, x);
+}
+
+static void sqrt_batch_scalar(const double *in, double *out, size_t n, int steps)
+{
+	if (steps < 0) {
+		steps = STEPS_MAGIC;
+	}
+	for (size_t i=0; i<n; i++) {
+		out[i] = sqrt_one(in[i], steps);
+	}
+}
+
+#ifdef HAVE_X86
+__attribute__((target("avx2,fma")))
+static void sqrt_batch_avx2(const double *in, double *out, size_t n, int steps)
+{
+	if (steps < 0) {
+		steps = STEPS_MAGIC;
+	}
+
+	const __m256i magic = _mm256_set1_epi64x((long long)RSQRT_MAGIC);
+	const __m256d half = _mm256_set1_pd(0.5);
+	const __m256d three_halves = _mm256_set1_pd(1.5);
+	const __m256d min_normal = _mm256_set1_pd(0x1p-1022);
+	const __m256d max_normal = _mm256_set1_pd(0x1.fffffffffffffp+1023);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d x = _mm256_loadu_pd(in + i);
+		__m256d y = _mm256_castsi256_pd(_mm256_sub_epi64(magic,
+				_mm256_srli_epi64(_mm256_castpd_si256(x), 1)));
+		__m256d hx = _mm256_mul_pd(half, x);
+		for (int k=0; k<steps; k++) {
+			__m256d yy = _mm256_mul_pd(y, y);
+			y = _mm256_mul_pd(y, _mm256_fnmadd_pd(hx, yy, three_halves));
+		}
+		__m256d s = _mm256_mul_pd(x, y);
+		__m256d r = _mm256_fnmadd_pd(s, s, x);
+		s = _mm256_fmadd_pd(_mm256_mul_pd(half, y), r, s);
+
+		// zero, negative, subnormal, infinite and NaN lanes go to the hardware
+		__m256d normal = _mm256_and_pd(_mm256_cmp_pd(x, min_normal, _CMP_GE_OQ),
+				_mm256_cmp_pd(x, max_normal, _CMP_LE_OQ));
+		if (_mm256_movemask_pd(normal) != 0xf) {
+			s = _mm256_blendv_pd(_mm256_sqrt_pd(x), s, normal);
+		}
+		_mm256_storeu_pd(out + i, s);
+	}
+	sqrt_batch_scalar(in + i, out + i, n - i, steps);
+}
+
+__attribute__((target("avx512f")))
+static void sqrt_batch_avx512(const double *in, double *out, size_t n, int steps)
+{
+	if (steps < 0) {
+		steps = STEPS_RSQRT14;
+	}
+
+	const __m512d half = _mm512_set1_pd(0.5);
+	const __m512d three_halves = _mm512_set1_pd(1.5);
+	const __m512d min_normal = _mm512_set1_pd(0x1p-1022);
+	const __m512d max_normal = _mm512_set1_pd(0x1.fffffffffffffp+1023);
+
+	size_t i = 0;
+	for (; i < n; i += 8) {
+		// the tail is done with a masked load and store
+		__mmask8 lanes = n - i >= 8 ? 0xff : (__mmask8)((1u << (n - i)) - 1);
+		__m512d x = _mm512_maskz_loadu_pd(lanes, in + i);
+		__m512d y = _mm512_rsqrt14_pd(x);
+		__m512d hx = _mm512_mul_pd(half, x);
+		for (int k=0; k<steps; k++) {
+			__m512d yy = _mm512_mul_pd(y, y);
+			y = _mm512_mul_pd(y, _mm512_fnmadd_pd(hx, yy, three_halves));
+		}
+		__m512d s = _mm512_mul_pd(x, y);
+		__m512d r = _mm512_fnmadd_pd(s, s, x);
+		s = _mm512_fmadd_pd(_mm512_mul_pd(half, y), r, s);
+
+		__mmask8 normal = _mm512_cmp_pd_mask(x, min_normal, _CMP_GE_OQ)
+				& _mm512_cmp_pd_mask(x, max_normal, _CMP_LE_OQ);
+		if ((normal & lanes) != lanes) {
+			s = _mm512_mask_sqrt_pd(s, (__mmask8)~normal, x);
+		}
+		_mm512_mask_storeu_pd(out + i, lanes, s);
+	}
+}
+#endif
+
+/*
+ * Find out whether the processor supports an instruction set sqrt_batch can use.
+ *
+ * Parameters:
+ *		in: isa - one of the SQRT_ISA_ values
+ *
+ * Returns:
+ *		true if sqrt_batch really uses that instruction set when asked to
+ */
+bool sqrt_batch_isa_supported(int isa)
+{
+	switch (isa) {
+	case SQRT_ISA_AUTO:
+	case SQRT_ISA_SCALAR:
+		return true;
+#ifdef HAVE_X86
+	case SQRT_ISA_AVX2:
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	case SQRT_ISA_AVX512:
+		return __builtin_cpu_supports("avx512f");
+#endif
+	default:
+		return false;
+	}
+}
+
+/*
+ * Calculate the square roots of an array of numbers.  Depending on sqrt_batch_isa
+ * and the processor, this uses AVX-512, AVX2 or plain C.  Every path starts from
+ * an estimate of the reciprocal square root and refines it with sqrt_batch_steps
+ * Newton steps.
+ *
+ * Parameters:
+ *		in: in - the numbers to take the square roots of
+ *		out: out - the square roots (may be the same array as in)
+ *		in: n - the number of values in in and out
+ *
+ * Returns n/a
+ */
+void sqrt_batch(const double *in, double *out, size_t n)
+{
+#ifdef HAVE_X86
+	int isa = sqrt_batch_isa;
+	if ((isa == SQRT_ISA_AUTO || isa == SQRT_ISA_AVX512) && sqrt_batch_isa_supported(SQRT_ISA_AVX512)) {
+		sqrt_batch_avx512(in, out, n, sqrt_batch_steps);
+		return;
+	}
+	if (isa != SQRT_ISA_SCALAR && sqrt_batch_isa_supported(SQRT_ISA_AVX2)) {
+		sqrt_batch_avx2(in, out, n, sqrt_batch_steps);
+		return;
+	}
+#endif
+	sqrt_batch_scalar(in, out, n, sqrt_batch_steps);
+}
+
+/*
+ * a = a * m.  Returns true if the result overflowed 256 bits.
+ */
+static bool u256_mul_small(U256 *a, uint64_t m)
+{
+	unsigned __int128 carry = 0;
+	for (int i=0; i<4; i++) {
+		unsigned __int128 v = (unsigned __int128)a->w[i] * m + carry;
+		a->w[i] = (uint64_t)v;
+		carry = v >> 64;
+	}
+	return carry != 0;
+}
+
+/*
+ * The 256-bit square of a 128-bit number.
+ */
+static U256 u256_square(unsigned __int128 x)
+{
+	uint64_t lo = (uint64_t)x, hi = (uint64_t)(x >> 64);
+	unsigned __int128 ll = (unsigned __int128)lo * lo;
+	unsigned __int128 lh = (unsigned __int128)lo * hi;
+	unsigned __int128 hh = (unsigned __int128)hi * hi;
+
+	U256 r;
+	r.w[0] = (uint64_t)ll;
+	// the middle term lh appears twice
+	unsigned __int128 mid = (ll >> 64) + (uint64_t)lh + (uint64_t)lh;
+	r.w[1] = (uint64_t)mid;
+	mid = (mid >> 64) + (lh >> 64) + (lh >> 64) + (uint64_t)hh;
+	r.w[2] = (uint64_t)mid;
+	r.w[3] = (uint64_t)((mid >> 64) + (hh >> 64));
+	return r;
+}
+
+static int u256_cmp(const U256 *a, const U256 *b)
+{
+	for (int i=3; i>=0; i--) {
+		if (a->w[i] != b->w[i]) {
+			return a->w[i] < b->w[i] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * a - b as a long double, which may be negative.
+ */
+static long double u256_diff(const U256 *a, const U256 *b)
+{
+	const U256 *big = a, *small = b;
+	long double sign = 1;
+	if (u256_cmp(a, b) < 0) {
+		big = b;
+		small = a;
+		sign = -1;
+	}
+	uint64_t borrow = 0;
+	long double v = 0;
+	uint64_t d[4];
+	for (int i=0; i<4; i++) {
+		uint64_t x = big->w[i] - small->w[i] - borrow;
+		borrow = big->w[i] < small->w[i] || (big->w[i] == small->w[i] && borrow);
+		d[i] = x;
+	}
+	for (int i=3; i>=0; i--) {
+		v = v * 18446744073709551616.0L + d[i];
+	}
+	return sign * v;
+}
+
+/*
+ * Calculate the square root of an integer as a fixed-point number with k decimal
+ * places, exactly: the result is floor(sqrt(n) * 10^k), the integer square root
+ * of n * 10^2k.  No floating point result is trusted; a long double estimate is
+ * corrected with one Newton step in integer arithmetic and then checked against
+ * the 256-bit radicand, so every digit is exact.
+ *
+ * Parameters:
+ *		in: n - the number to find the square root of
+ *		in: k - the number of decimal places (for n = 2, at most SQRT2_U128_DIGITS)
+ *
+ * Returns:
+ *		floor(sqrt(n) * 10^k), or 0 if that does not fit in 128 bits
+ */
+unsigned __int128 sqrt_u128(uint64_t n, unsigned int k)
+{
+	// the radicand n * 10^2k, multiplied in steps of at most 10^19 (which fits in 64 bits)
+	U256 radicand = { { n, 0, 0, 0 } };
+	for (unsigned int e = 2 * k; e > 0; ) {
+		unsigned int step = e < 19 ? e : 19;
+		uint64_t p = 1;
+		for (unsigned int i=0; i<step; i++) {
+			p *= 10;
+		}
+		if (u256_mul_small(&radicand, p)) {
+			return 0;
+		}
+		e -= step;
+	}
+
+	long double approx = 0;
+	for (int i=3; i>=0; i--) {
+		approx = approx * 18446744073709551616.0L + radicand.w[i];
+	}
+	approx = sqrtl(approx);
+	if (approx >= 340282366920938463463374607431768211455.0L) {
+		return 0;
+	}
+
+	// the estimate is good to about 64 bits; one Newton step x += (N - x^2) / 2x
+	// takes it to within one of the answer
+	unsigned __int128 x = (unsigned __int128)approx;
+	if (x > 0) {
+		U256 sq = u256_square(x);
+		long double delta = u256_diff(&radicand, &sq) / (2.0L * (long double)x);
+		x += (__int128)delta;
+	}
+
+	// make it exact
+	for (;;) {
+		U256 sq = u256_square(x);
+		if (u256_cmp(&sq, &radicand) <= 0) {
+			break;
+		}
+		x--;
+	}
+	for (;;) {
+		if (x + 1 == 0) {
+			break;
+		}
+		U256 sq = u256_square(x + 1);
+		if (u256_cmp(&sq, &radicand) > 0) {
+			break;
+		}
+		x++;
+	}
+	return x;
+}
+
+/*
+ * Convert a fixed-point number with k decimal places to a string.
+ *
+ * Parameters:
+ *		in: x - the number, scaled by 10^k
+ *		in: k - the number of decimal places (at most FIXED128_MAX_PLACES)
+ *		out: buf - space for the string (at most 41 + k characters)
+ *
+ * Returns:
+ *		buf, or NULL (and buf is left empty) if k is too big
+ */
+char *fixed128_to_string(unsigned __int128 x, unsigned int k, char *buf)
+{
+	char digits[FIXED128_MAX_PLACES + 2];		// all of x, or k places and a leading zero
+	if (k > FIXED128_MAX_PLACES) {
+		buf[0] = '\0';
+		return NULL;
+	}
+	int len = 0;
+	do {
+		digits[len++] = (char)('0' + (int)(x % 10));
+		x /= 10;
+	} while (x > 0 || len <= (int)k);
+
+	char *p = buf;
+	while (len > 0) {
+		*(p++) = digits[--len];
+		if (len == (int)k && k > 0) {
+			*(p++) = '.';
+		}
+	}
+	*p = '\0';
+	return buf;
+}
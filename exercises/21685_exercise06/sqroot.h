@@ -1,3 +1,38 @@
+#ifndef SQROOT_H
+#define SQROOT_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// instruction sets sqrt_batch can use (see sqrt_batch_isa)
+#define SQRT_ISA_AUTO		0	// the best one the processor supports
+#define SQRT_ISA_SCALAR		1
+#define SQRT_ISA_AVX2		2
+#define SQRT_ISA_AVX512		3
+
+// Number of Newton steps sqrt_batch runs on its reciprocal square root estimate.
+// A negative value means as many as the instruction set needs for full double
+// precision.  Fewer steps are faster but less accurate.
+extern int sqrt_batch_steps;
+
+// Instruction set for sqrt_batch to use, one of the SQRT_ISA_ values.  If the
+// processor does not support it, the next best one is used.
+extern int sqrt_batch_isa;
+
+// Digits after the decimal point sqrt_u128 can give for the square root of two.
+// sqrt(2) * 10^38 is about 1.41e38, under 2^128 (about 3.40e38); 10^39 is too many.
+#define SQRT2_U128_DIGITS	38
+
+// Most decimal places fixed128_to_string takes.  A 128-bit number has at most 39
+// digits, so more places could only ever be leading zeros.
+#define FIXED128_MAX_PLACES	38
 
 double sqrt2();
+double sqrt_newton(double value);
+void sqrt_batch(const double *in, double *out, size_t n);
+bool sqrt_batch_isa_supported(int isa);
+unsigned __int128 sqrt_u128(uint64_t n, unsigned int k);
+char *fixed128_to_string(unsigned __int128 x, unsigned int k, char *buf);
+
+#endif
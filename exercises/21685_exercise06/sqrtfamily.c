@@ -0,0 +1,118 @@
+#include <math.h>
+#ifdef __SIZEOF_FLOAT128__
+#include <quadmath.h>
+#endif
+
+#include <sqrtfamily.h>
+
+// Coefficients of the straight line a + b*m that is closest (in relative error) to
+// sqrt(m) for 0.5 <= m < 1.  It is within 0.75%, a little over 7 bits.
+#define GUESS_A		0.41731
+#define GUESS_B		0.59016
+#define SQRT_HALF	0.70710678118654752440084436210484903928483593768847
+
+/*
+ * a*b + c for a product within a factor of two of -c, as the square root needs it,
+ * rounded once like fmal.  x87 has no fused multiply-add and glibc's fmal works in
+ * software, over ten times slower than the square root's other steps together, so
+ * the product is split into halves that multiply exactly (Dekker's method), and
+ * c + a*b, which needs no rounding for such a product, takes the error off.  The
+ * values are always near one, so nothing can overflow or be denormal.
+ */
+static inline long double fma_near(long double a, long double b, long double c)
+{
+#if LDBL_MANT_DIG == 64
+	const long double split = 0x1p32L + 1;
+	long double p = a * b;
+	long double ta = a * split, tb = b * split;
+	long double ah = ta - (ta - a), bh = tb - (tb - b);
+	long double al = a - ah, bl = b - bh;
+	long double e = ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+	return (c + p) + e;
+#else
+	return fmal(a, b, c);
+#endif
+}
+
+/*
+ * Define a square root function for a floating point type.  x is split into
+ * m * 2^e with 0.5 <= m < 1 (or m/2 and an even e), the square root of m is
+ * guessed with a straight line and refined with a fixed number of Newton steps,
+ * then scaled by 2^(e/2), which is exact, so the rounding is the same for tiny and
+ * huge values as for ones near one.  steps is a compile time constant, so the loop
+ * has no tolerance test and is unrolled by the compiler.  The steps leave y within
+ * an ulp or so, and the division in each rounds; a last step on the residual
+ * m - y*y, which one fused
+ * multiply-add gives exactly, and then Tuckerman's test against the midpoints
+ * between y and its neighbours make it the correctly rounded square root, the
+ * same as the C library's.
+ *
+ * Only positive finite values are handled this way; zero is returned as is and
+ * anything else (negative, infinite, NaN) gives a NaN.
+ */
+#define DEFINE_SQRT(name, type, frexp_fn, ldexp_fn, fma_fn, nextafter_fn, steps) \
+type name(type x)															\
+{																			\
+	if (!(x > 0 && x - x == 0)) {											\
+		return x == 0 ? x : (x - x) / (x - x);								\
+	}																		\
+	int e;																	\
+	type m = frexp_fn(x, &e);												\
+	type y = (type)GUESS_A + (type)GUESS_B * m;								\
+	if (e & 1) {															\
+		/* sqrt(m * 2^e) = sqrt(m/2) * 2^((e+1)/2) */						\
+		y *= (type)SQRT_HALF;												\
+		m /= 2;																\
+		e++;																\
+	}																		\
+	for (int i=0; i<(steps); i++) {											\
+		y = (y + m / y) / 2;												\
+	}																		\
+	y += fma_fn(-y, y, m) / (2 * y);										\
+	/* Tuckerman's test: y*(next y) is about the square of the midpoint */	\
+	type below = nextafter_fn(y, 0), above = nextafter_fn(y, 2 * y);		\
+	if (fma_fn(-y, above, m) > 0) {											\
+		y = above;															\
+	}																		\
+	else if (fma_fn(-y, below, m) <= 0) {									\
+		y = below;															\
+	}																		\
+	return ldexp_fn(y, e / 2);												\
+}
+
+DEFINE_SQRT(sqrt_float, float, frexpf, ldexpf, fmaf, nextafterf, SQRT_STEPS(FLT_MANT_DIG))
+DEFINE_SQRT(sqrt_double, double, frexp, ldexp, fma, nextafter, SQRT_STEPS(DBL_MANT_DIG))
+DEFINE_SQRT(sqrt_long_double, long double, frexpl, ldexpl, fma_near, nextafterl, SQRT_STEPS(LDBL_MANT_DIG))
+#ifdef HAVE_FLOAT128
+DEFINE_SQRT(sqrt_float128, __float128, frexpq, ldexpq, fmaq, nextafterq, SQRT_STEPS(FLOAT128_MANT_DIG))
+#endif
+
+/*
+ * Calculate the square root of a fixed-point number.  The square root of x with
+ * 32 fraction bits is the integer square root of x * 2^32, which is found with
+ * integer Newton steps starting from a power of two above it.  The steps approach
+ * the root from above, so after FIXED_SQRT_STEPS of them at most one correction
+ * is needed.
+ *
+ * Parameters:
+ *		in: x - the number to find the square root of
+ *
+ * Returns:
+ *		The square root of x, rounded down
+ */
+fixed_t sqrt_fixed(fixed_t x)
+{
+	if (x == 0) {
+		return 0;
+	}
+	unsigned __int128 n = (unsigned __int128)x << FIXED_FRAC_BITS;
+	int bits = 64 - __builtin_clzll(x) + FIXED_FRAC_BITS;		// bits in n
+	unsigned __int128 y = (unsigned __int128)1 << ((bits + 1) / 2);
+	for (int i=0; i<FIXED_SQRT_STEPS; i++) {
+		y = (y + n / y) / 2;
+	}
+	if (y * y > n) {
+		y--;
+	}
+	return (fixed_t)y;
+}
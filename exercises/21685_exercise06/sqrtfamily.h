@@ -0,0 +1,49 @@
+#ifndef SQRTFAMILY_H
+#define SQRTFAMILY_H
+
+#include <stdint.h>
+#include <float.h>
+
+// The starting guess of the typed square roots is good to at least this many bits.
+// A Newton step takes b correct bits to 2b+1, so k steps give (b+1)*2^k - 1 bits.
+#define SQRT_GUESS_BITS		7
+#define SQRT_BITS_AFTER(k)	(((SQRT_GUESS_BITS + 1) << (k)) - 1)
+
+// Newton steps needed to reach a number of bits from the starting guess.  This is
+// a constant expression so each type's loop count is fixed when it is compiled.
+#define SQRT_STEPS(bits)	((bits) <= SQRT_BITS_AFTER(0) ? 0 : \
+							 (bits) <= SQRT_BITS_AFTER(1) ? 1 : \
+							 (bits) <= SQRT_BITS_AFTER(2) ? 2 : \
+							 (bits) <= SQRT_BITS_AFTER(3) ? 3 : \
+							 (bits) <= SQRT_BITS_AFTER(4) ? 4 : 5)
+
+#if defined(__SIZEOF_FLOAT128__)
+#define HAVE_FLOAT128		1
+#define FLOAT128_MANT_DIG	113
+#endif
+
+// unsigned fixed-point numbers with 32 integer and 32 fraction bits
+typedef uint64_t fixed_t;
+#define FIXED_FRAC_BITS		32
+#define FIXED_ONE			((fixed_t)1 << FIXED_FRAC_BITS)
+#define FIXED_SQRT_STEPS	6	// from a power of two guess (within a factor of 2)
+
+float sqrt_float(float x);
+double sqrt_double(double x);
+long double sqrt_long_double(long double x);
+#ifdef HAVE_FLOAT128
+__float128 sqrt_float128(__float128 x);
+#endif
+fixed_t sqrt_fixed(fixed_t x);
+
+// Pick the square root for the type of x
+#ifdef HAVE_FLOAT128
+#define sqrt_typed(x)	_Generic((x), float: sqrt_float, double: sqrt_double, \
+						long double: sqrt_long_double, __float128: sqrt_float128, \
+						fixed_t: sqrt_fixed)(x)
+#else
+#define sqrt_typed(x)	_Generic((x), float: sqrt_float, double: sqrt_double, \
+						long double: sqrt_long_double, fixed_t: sqrt_fixed)(x)
+#endif
+
+#endif
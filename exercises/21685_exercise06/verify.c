@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86	1
+#endif
+
+#include <verify.h>
+
+static size_t first_mismatch_scalar(const char *a, const char *b, size_t n)
+{
+	size_t i = 0;
+	while (i < n && a[i] == b[i]) {
+		i++;
+	}
+	return i;
+}
+
+#ifdef HAVE_X86
+static size_t first_mismatch_sse2(const char *a, const char *b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		unsigned int equal = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+		if (equal != 0xffff) {
+			return i + __builtin_ctz(~equal);
+		}
+	}
+	return i + first_mismatch_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t first_mismatch_avx2(const char *a, const char *b, size_t n)
+{
+	size_t i = 0;
+	// two vectors per iteration, checked together so the loop has one branch
+	for (; i + 64 <= n; i += 64) {
+		__m256i e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)),
+				_mm256_loadu_si256((const __m256i *)(b + i)));
+		__m256i e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i + 32)),
+				_mm256_loadu_si256((const __m256i *)(b + i + 32)));
+		if ((unsigned int)_mm256_movemask_epi8(_mm256_and_si256(e0, e1)) != 0xffffffffu) {
+			unsigned int m0 = (unsigned int)_mm256_movemask_epi8(e0);
+			if (m0 != 0xffffffffu) {
+				return i + __builtin_ctz(~m0);
+			}
+			return i + 32 + __builtin_ctz(~(unsigned int)_mm256_movemask_epi8(e1));
+		}
+	}
+	return i + first_mismatch_sse2(a + i, b + i, n - i);
+}
+#endif
+
+/*
+ * Find the first position at which two strings of digits differ.
+ *
+ * Parameters:
+ *		in: a, b - the characters to compare
+ *		in: n - the number of characters to compare
+ *
+ * Returns:
+ *		The index of the first character that differs, or n if they are the same.
+ */
+size_t first_mismatch(const char *a, const char *b, size_t n)
+{
+#ifdef HAVE_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return first_mismatch_avx2(a, b, n);
+	}
+	return first_mismatch_sse2(a, b, n);
+#else
+	return first_mismatch_scalar(a, b, n);
+#endif
+}
+
+// work shared by the threads of first_mismatch_parallel
+typedef struct shard_work_struct {
+	const char *a;
+	const char *b;
+	size_t n;
+	size_t shards;					// number of shards in a and b
+	atomic_size_t next_shard;		// the next shard for a thread to take
+	atomic_size_t mismatch;			// the lowest mismatch found so far, n if none
+} ShardWork;
+
+/*
+ * Thread body for first_mismatch_parallel.  Take shards in order until they run
+ * out or they start past a mismatch another thread has already found.
+ */
+static void *compare_shards(void *arg)
+{
+	ShardWork *work = (ShardWork *)arg;
+	for (;;) {
+		size_t shard = atomic_fetch_add(&work->next_shard, 1);
+		size_t start = shard * VERIFY_SHARD_SIZE;
+		if (shard >= work->shards || start >= atomic_load(&work->mismatch)) {
+			break;
+		}
+		size_t len = work->n - start < VERIFY_SHARD_SIZE ? work->n - start : VERIFY_SHARD_SIZE;
+		size_t m = first_mismatch(work->a + start, work->b + start, len);
+		if (m < len) {
+			// keep the lowest position; another thread may have found an earlier one
+			size_t found = start + m;
+			size_t current = atomic_load(&work->mismatch);
+			while (found < current && !atomic_compare_exchange_weak(&work->mismatch, &current, found)) {
+			}
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Find the first position at which two strings of digits differ, using several
+ * threads.  The strings are split into shards of VERIFY_SHARD_SIZE bytes, which the
+ * threads take in order, so a difference found in one shard lets the threads skip
+ * all the shards after it.
+ *
+ * Parameters:
+ *		in: a, b - the characters to compare
+ *		in: n - the number of characters to compare
+ *		in: threads - the number of threads to use
+ *
+ * Returns:
+ *		The index of the first character that differs, or n if they are the same.
+ */
+size_t first_mismatch_parallel(const char *a, const char *b, size_t n, int threads)
+{
+	ShardWork work;
+	work.a = a;
+	work.b = b;
+	work.n = n;
+	work.shards = (n + VERIFY_SHARD_SIZE - 1) / VERIFY_SHARD_SIZE;
+	atomic_init(&work.next_shard, 0);
+	atomic_init(&work.mismatch, n);
+
+	if (threads > (int)work.shards) {
+		threads = (int)work.shards;
+	}
+	if (threads <= 1) {
+		return first_mismatch(a, b, n);
+	}
+
+	pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+	int started = 0;
+	if (ids) {
+		for (; started < threads - 1; started++) {
+			if (pthread_create(&ids[started], NULL, compare_shards, &work) != 0) {
+				break;
+			}
+		}
+	}
+	compare_shards(&work);		// this thread works too
+	for (int i=0; i<started; i++) {
+		pthread_join(ids[i], NULL);
+	}
+	free(ids);
+
+	return atomic_load(&work.mismatch);
+}
+
+/*
+ * A digit_source that reads from a FILE *.  Like read_file, it discards all
+ * characters except digits and the decimal point, so line breaks and spaces in the
+ * file do not count as positions.
+ *
+ * Parameters:
+ *		in: fp - the FILE * to read from (passed as void * to match digit_source)
+ *		out: buf - space for the digits
+ *		in: len - the size of buf
+ *
+ * Returns:
+ *		The number of characters stored in buf, 0 at end of file.
+ */
+size_t file_digits(void *fp, char *buf, size_t len)
+{
+	size_t kept = 0;
+	while (kept == 0) {
+		size_t got = fread(buf, 1, len, (FILE *)fp);
+		if (got == 0) {
+			return 0;
+		}
+		// compact in place, skipping the characters that are not part of the number
+		for (size_t i=0; i<got; i++) {
+			char c = buf[i];
+			if ((c >= '0' && c <= '9') || c == '.') {
+				buf[kept++] = c;
+			}
+		}
+	}
+	return kept;
+}
+
+/*
+ * Compare two streams of digits and find the first position at which they differ.
+ * Each stream is read in blocks of VERIFY_BLOCK_SIZE, so memory use does not depend
+ * on how many digits there are.  As with the comparison in main, comparison stops
+ * at the end of the shorter stream.
+ *
+ * Parameters:
+ *		in: ref, ref_ctx - the source of the reference digits and its context
+ *		in: calc, calc_ctx - the source of the computed digits and its context
+ *		out: matched - the number of characters that are the same
+ *
+ * Returns:
+ *		true if the streams are the same up to the end of the shorter one, false if
+ *		they differ, if either has no digits at all, or if memory could not be
+ *		allocated (the last two are reported on stderr).
+ */
+bool verify_stream(digit_source ref, void *ref_ctx, digit_source calc, void *calc_ctx, size_t *matched)
+{
+	char *a = (char *)malloc(2 * VERIFY_BLOCK_SIZE);
+	if (!a) {
+		fprintf(stderr, "Unable to allocate %d bytes for the verify buffers\n", 2 * VERIFY_BLOCK_SIZE);
+		*matched = 0;
+		return false;
+	}
+	char *b = a + VERIFY_BLOCK_SIZE;
+
+	size_t total = 0;				// characters compared so far
+	size_t na = 0, nb = 0;			// characters in each buffer
+	size_t pa = 0, pb = 0;			// characters of each buffer already compared
+	bool same = true;
+	for (;;) {
+		if (pa == na) {
+			na = ref(ref_ctx, a, VERIFY_BLOCK_SIZE);
+			pa = 0;
+		}
+		if (pb == nb) {
+			nb = calc(calc_ctx, b, VERIFY_BLOCK_SIZE);
+			pb = 0;
+		}
+		if (na == 0 || nb == 0) {
+			// an empty stream matches nothing, rather than everything
+			if (total == 0) {
+				fprintf(stderr, "Unable to read any %s digits\n", na == 0 ? "reference" : "computed");
+				same = false;
+			}
+			break;
+		}
+
+		// the sources can return different amounts, so compare what both have
+		size_t n = na - pa < nb - pb ? na - pa : nb - pb;
+		size_t m = first_mismatch(a + pa, b + pb, n);
+		total += m;
+		if (m < n) {
+			same = false;
+			break;
+		}
+		pa += n;
+		pb += n;
+	}
+
+	free(a);
+	*matched = total;
+	return same;
+}
@@ -0,0 +1,19 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define VERIFY_BLOCK_SIZE	(1 << 16)	// bytes of each stream held in memory at once
+#define VERIFY_SHARD_SIZE	(1 << 18)	// bytes compared by one thread at a time
+
+// A source of digits for verify_stream.  Fills buf with up to len characters and
+// returns how many it stored; 0 means the end of the digits.
+typedef size_t (*digit_source)(void *ctx, char *buf, size_t len);
+
+size_t first_mismatch(const char *a, const char *b, size_t n);
+size_t first_mismatch_parallel(const char *a, const char *b, size_t n, int threads);
+size_t file_digits(void *fp, char *buf, size_t len);
+bool verify_stream(digit_source ref, void *ref_ctx, digit_source calc, void *calc_ctx, size_t *matched);
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sort.h>
+#include <psort.h>
+
+#define DEFAULT_COUNT	10000000	// number of random values to sort
+#define RUNS			3			// runs per thread count; the fastest is reported
+
+/*
+ * Return the time in milliseconds from a monotonic clock.
+ */
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool is_sorted(const double *a, size_t n)
+{
+	for (size_t i=1; i<n; i++) {
+		if (a[i] < a[i-1]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Time sort_doubles_parallel on the same random values with 1, 2, ... up to the
+ * given number of threads, and show how much faster each is than one thread.
+ *
+ * Parameters:
+ *		argv - optional, "-n count" values to sort, "-t threads" the most threads to
+ *				use (the number of processors by default)
+ *
+ * Returns:
+ *		0 on success, else 1
+ */
+int main(int argc, char *argv[])
+{
+	size_t n = DEFAULT_COUNT;
+	int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atol(argv[i+1]) > 0) {
+			n = (size_t)atol(argv[++i]);
+		} else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc && atoi(argv[i+1]) > 0) {
+			max_threads = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "Usage: %s [-n count] [-t threads]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (max_threads < 1) {
+		max_threads = 1;
+	}
+
+	double *values = (double *)malloc(n * sizeof(double));
+	double *array = (double *)malloc(n * sizeof(double));
+	if (!values || !array) {
+		fprintf(stderr, "Unable to allocate %ld bytes for the values\n", (long) (2 * n * sizeof(double)));
+		free(values);
+		free(array);
+		return 1;
+	}
+	uint64_t state = 88172645463325252ull;
+	for (size_t i=0; i<n; i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		values[i] = (double)(int64_t)state / 1e9;
+	}
+
+	printf("sorting %ld values\n", (long) n);
+	printf("threads         ms    speedup efficiency\n");
+	double base = 0;
+	for (int t=1; t<=max_threads; t++) {
+		double best = 0;
+		for (int run=0; run<RUNS; run++) {
+			memcpy(array, values, n * sizeof(double));
+			double start = now_ms();
+			sort_doubles_parallel(array, n, t);
+			double ms = now_ms() - start;
+			if (run == 0 || ms < best) {
+				best = ms;
+			}
+			if (!is_sorted(array, n)) {
+				fprintf(stderr, "The values are not sorted with %d threads\n", t);
+				free(values);
+				free(array);
+				return 1;
+			}
+		}
+		if (t == 1) {
+			base = best;
+		}
+		printf("%7d %10.1f %10.2f %10.2f\n", t, best, base / best, base / best / t);
+	}
+
+	free(values);
+	free(array);
+	return 0;
+}
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <datacache.h>
+
+bool use_data_cache = false;
+
+// a cache file mapped by cache_load, remembered so cache_release can unmap it
+typedef struct mapping_struct {
+	double *values;
+	void *base;
+	size_t length;
+	struct mapping_struct *next;
+} Mapping;
+
+static Mapping *mappings = NULL;
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *cache_name(const char *file_name)
+{
+	size_t len = strlen(file_name);
+	char *name = (char *)malloc(len + sizeof(CACHE_SUFFIX));
+	if (name) {
+		memcpy(name, file_name, len);
+		memcpy(name + len, CACHE_SUFFIX, sizeof(CACHE_SUFFIX));
+	}
+	return name;
+}
+
+/*
+ * A checksum of an array of doubles, to catch a cache file that has been cut short
+ * or damaged.  Four words are mixed at a time, in independent lanes, so it runs at
+ * close to memory speed.
+ */
+uint64_t cache_checksum(const double *values, size_t count)
+{
+	const uint64_t prime = 0x100000001b3ull;
+	uint64_t h[4] = { 0xcbf29ce484222325ull, 0x84222325cbf29ce4ull, 0x9e3779b97f4a7c15ull, 0x7f4a7c159e3779b9ull };
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		for (int lane=0; lane<4; lane++) {
+			uint64_t w;
+			memcpy(&w, &values[i + lane], sizeof(w));
+			h[lane] = (h[lane] ^ w) * prime;
+		}
+	}
+	for (; i < count; i++) {
+		uint64_t w;
+		memcpy(&w, &values[i], sizeof(w));
+		h[0] = (h[0] ^ w) * prime;
+	}
+	uint64_t sum = count;
+	for (int lane=0; lane<4; lane++) {
+		sum = (sum ^ h[lane]) * prime;
+		sum ^= sum >> 29;
+	}
+	return sum;
+}
+
+/*
+ * Map the cache of a data file, if it has one and it is up to date: the size and
+ * modification time of the data file must be the ones the cache was made from, and
+ * the values must match the checksum.  The values are mapped copy-on-write, so the
+ * caller can change them (to sort them, say) without changing the cache.  Checking
+ * the checksum reads every value once, so a load is not free, but it is one pass
+ * over the doubles instead of parsing the text.
+ *
+ * Parameters:
+ *		in: file_name - the name of the data file
+ *		in: source - the data file's status, from stat or fstat
+ *		out: size - the number of values
+ *
+ * Returns:
+ *		The values, to be given back with cache_release, or NULL if there is no usable
+ *		cache (this is not reported as an error).
+ */
+double *cache_load(const char *file_name, const struct stat *source, size_t *size)
+{
+	if (!use_data_cache) {
+		return NULL;
+	}
+	char *name = cache_name(file_name);
+	if (!name) {
+		return NULL;
+	}
+	int fd = open(name, O_RDONLY);
+	free(name);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	// check the header before mapping anything
+	CacheHeader header;
+	struct stat st;
+	bool valid = fstat(fd, &st) == 0
+			&& read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header)
+			&& memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0
+			&& header.source_size == (uint64_t)source->st_size
+			&& header.source_mtime_sec == (int64_t)source->st_mtim.tv_sec
+			&& header.source_mtime_nsec == (int64_t)source->st_mtim.tv_nsec
+			&& header.count <= (SIZE_MAX - CACHE_HEADER_SIZE) / sizeof(double)
+			&& (uint64_t)st.st_size == CACHE_HEADER_SIZE + header.count * sizeof(double);
+	if (!valid) {
+		close(fd);
+		return NULL;
+	}
+
+	size_t length = (size_t)st.st_size;
+	void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return NULL;
+	}
+	double *values = (double *)((char *)base + CACHE_HEADER_SIZE);
+	Mapping *m = (Mapping *)malloc(sizeof(Mapping));
+	if (!m || cache_checksum(values, (size_t)header.count) != header.checksum) {
+		free(m);
+		munmap(base, length);
+		return NULL;
+	}
+
+	m->values = values;
+	m->base = base;
+	m->length = length;
+	pthread_mutex_lock(&mappings_lock);
+	m->next = mappings;
+	mappings = m;
+	pthread_mutex_unlock(&mappings_lock);
+
+	*size = (size_t)header.count;
+	return values;
+}
+
+/*
+ * Write the cache for a data file that has just been parsed.  The cache is written
+ * to a temporary file which is then renamed, so a reader never sees half of one.
+ * A cache that cannot be written (in a read-only directory, say) is skipped
+ * silently, since the data file can always be parsed again.
+ *
+ * Parameters:
+ *		in: file_name - the name of the data file
+ *		in: source - the data file's status when it was read
+ *		in: values, count - the values parsed from it
+ */
+void cache_store(const char *file_name, const struct stat *source, const double *values, size_t count)
+{
+	if (!use_data_cache) {
+		return;
+	}
+	char *name = cache_name(file_name);
+	char *temp = name ? (char *)malloc(strlen(name) + 8) : NULL;
+	if (!temp) {
+		free(name);
+		return;
+	}
+	sprintf(temp, "%s.XXXXXX", name);
+	int fd = mkstemp(temp);
+	if (fd < 0) {
+		free(name);
+		free(temp);
+		return;
+	}
+	fchmod(fd, 0644);		// mkstemp makes it readable by the owner only
+
+	char header[CACHE_HEADER_SIZE];
+	CacheHeader h;
+	memset(header, 0, sizeof(header));
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+	h.count = count;
+	h.source_size = (uint64_t)source->st_size;
+	h.source_mtime_sec = (int64_t)source->st_mtim.tv_sec;
+	h.source_mtime_nsec = (int64_t)source->st_mtim.tv_nsec;
+	h.checksum = cache_checksum(values, count);
+	memcpy(header, &h, sizeof(h));
+
+	// write the header, then the values (write may take less than it is given)
+	bool ok = write(fd, header, sizeof(header)) == (ssize_t)sizeof(header);
+	const char *p = (const char *)values;
+	size_t left = count * sizeof(double);
+	while (ok && left > 0) {
+		ssize_t done = write(fd, p, left);
+		ok = done > 0;
+		if (ok) {
+			p += done;
+			left -= (size_t)done;
+		}
+	}
+	ok = close(fd) == 0 && ok;
+
+	if (!ok || rename(temp, name) != 0) {
+		unlink(temp);
+	}
+	free(name);
+	free(temp);
+}
+
+/*
+ * Give back values returned by cache_load.
+ *
+ * Returns:
+ *		true if the values came from cache_load and have been unmapped, false if they
+ *		did not (so they are the caller's to free)
+ */
+bool cache_release(double *values)
+{
+	pthread_mutex_lock(&mappings_lock);
+	Mapping **link = &mappings;
+	while (*link && (*link)->values != values) {
+		link = &(*link)->next;
+	}
+	Mapping *m = *link;
+	if (m) {
+		*link = m->next;
+	}
+	pthread_mutex_unlock(&mappings_lock);
+
+	if (!m) {
+		return false;
+	}
+	munmap(m->base, m->length);
+	free(m);
+	return true;
+}
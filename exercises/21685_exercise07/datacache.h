@@ -0,0 +1,34 @@
+#ifndef DATACACHE_H
+#define DATACACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#define CACHE_SUFFIX		".cache"	// added to the data file name to name its cache
+#define CACHE_MAGIC			"DBLCACH1"	// first eight bytes of every cache file
+#define CACHE_HEADER_SIZE	64			// the values start this far into the file
+
+// The start of a cache file.  The values follow at CACHE_HEADER_SIZE, as an array of
+// doubles in the byte order of the machine that wrote it.
+typedef struct cache_header_struct {
+	char magic[8];					// CACHE_MAGIC
+	uint64_t count;					// number of values
+	uint64_t source_size;			// size of the data file the values came from
+	int64_t source_mtime_sec;		// and when it was last modified
+	int64_t source_mtime_nsec;
+	uint64_t checksum;				// cache_checksum of the values
+} CacheHeader;
+
+// Whether read_file and read_file_parallel use cache files.  It is false unless a
+// program asks for it (exercise07 and exercise08 take -c), since each read of a
+// regular file would otherwise leave a <file>.cache next to it.
+extern bool use_data_cache;
+
+double *cache_load(const char *file_name, const struct stat *source, size_t *size);
+void cache_store(const char *file_name, const struct stat *source, const double *values, size_t count);
+bool cache_release(double *values);
+uint64_t cache_checksum(const double *values, size_t count);
+
+#endif
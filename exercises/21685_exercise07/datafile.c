@@ -0,0 +1,637 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <datafile.h>
+#include <datacache.h>
+
+// the values read so far, in an array that grows as needed
+typedef struct value_array_struct {
+	double *values;
+	size_t count;
+	size_t cap;
+} ValueArray;
+
+/*
+ * Add a value to the end of the array, doubling its size if it is full.
+ *
+ * Returns:
+ *		0 on success, else 1 (memory could not be allocated)
+ */
+static int append_value(ValueArray *a, double value)
+{
+	if (a->count == a->cap) {
+		size_t cap = a->cap * 2;
+		double *values = (double *)realloc(a->values, cap * sizeof(double));
+		if (!values) {
+			fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) (cap * sizeof(double)));
+			return 1;
+		}
+		a->values = values;
+		a->cap = cap;
+	}
+	a->values[a->count++] = value;
+	return 0;
+}
+
+// exact powers of ten: every one of them is a double without rounding
+static const double exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * Convert the decimal number at the start of a string to a double, correctly
+ * rounded, as strtod does.  Leading white space is skipped.
+ *
+ * Most numbers have at most 19 significant digits and a small power of ten.  When
+ * the digits fit in the 53 bit mantissa of a double and the power of ten is exact,
+ * one multiplication or division gives the correctly rounded value (Clinger's fast
+ * path), so these are converted here.  Anything else (more digits, large exponents,
+ * hexadecimal, infinity, NaN) is passed to strtod.
+ *
+ * Parameters:
+ *		in: s - the null-terminated string to convert
+ *		out: value - the number
+ *
+ * Returns:
+ *		The first character after the number, or s if there is no number.
+ */
+const char *parse_double(const char *s, double *value)
+{
+	const char *p = s;
+	while (*p == ' ' || (*p >= '\t' && *p <= '\r')) {
+		p++;
+	}
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+') {
+		p++;
+	}
+
+	// collect up to PARSE_MAX_DIGITS significant digits, noting where the point is
+	uint64_t mantissa = 0;
+	int digits = 0;				// significant digits in mantissa
+	int exponent = 0;			// power of ten to scale mantissa by
+	bool any = false;			// seen at least one digit
+	bool overflow = false;		// more digits than mantissa can hold
+	const char *start = p;
+	for (; *p >= '0' && *p <= '9'; p++) {
+		any = true;
+		if (mantissa == 0 && *p == '0') {
+			continue;
+		}
+		if (digits < PARSE_MAX_DIGITS) {
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+			digits++;
+		}
+		else {
+			overflow = true;
+		}
+	}
+	if (*p == '.') {
+		for (p++; *p >= '0' && *p <= '9'; p++) {
+			any = true;
+			if (mantissa == 0 && *p == '0') {
+				exponent--;
+				continue;
+			}
+			if (digits < PARSE_MAX_DIGITS) {
+				mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+				digits++;
+				exponent--;
+			}
+			else {
+				overflow = true;
+			}
+		}
+	}
+	// "0x" is the start of a hexadecimal number, not zero followed by junk
+	bool hex = p == start + 1 && *start == '0' && (*p == 'x' || *p == 'X');
+
+	if (any && !overflow && !hex) {
+		if (*p == 'e' || *p == 'E') {
+			// the exponent only counts if it has digits
+			const char *e = p + 1;
+			bool negative_exp = *e == '-';
+			if (*e == '-' || *e == '+') {
+				e++;
+			}
+			if (*e >= '0' && *e <= '9') {
+				int exp = 0;
+				for (; *e >= '0' && *e <= '9'; e++) {
+					if (exp < 100000) {
+						exp = exp * 10 + (*e - '0');
+					}
+				}
+				exponent += negative_exp ? -exp : exp;
+				p = e;
+			}
+		}
+
+		// an exponent above 22 is still exact if the extra powers of ten fit in the
+		// mantissa without rounding
+		while (exponent > 22 && mantissa <= (UINT64_C(1) << 53) / 10) {
+			mantissa *= 10;
+			exponent--;
+		}
+		if (mantissa <= (UINT64_C(1) << 53) && exponent >= -22 && exponent <= 22) {
+			double v = (double)mantissa;
+			v = exponent < 0 ? v / exact_pow10[-exponent] : v * exact_pow10[exponent];
+			*value = negative ? -v : v;
+			return p;
+		}
+		if (mantissa == 0) {
+			*value = negative ? -0.0 : 0.0;
+			return p;
+		}
+	}
+
+	// the slow path handles everything else, including not being a number at all
+	char *end;
+	*value = strtod(s, &end);
+	return end;
+}
+
+/*
+ * Open a data file to read its values a few at a time with data_stream_read, for
+ * when they will not all fit in memory.
+ *
+ * Parameters:
+ * 		in: file_name - the name of the file to read, or "-" for the standard input
+ *
+ * Returns:
+ *		The stream, which must be closed with data_stream_close, or NULL (an error
+ *		message has been printed).
+ */
+DataStream *data_stream_open(const char *file_name)
+{
+	DataStream *ds = (DataStream *)calloc(1, sizeof(DataStream));
+	if (!ds) {
+		fprintf(stderr, "Unable to allocate memory to read %s\n", file_name);
+		return NULL;
+	}
+	ds->file_name = file_name;
+	ds->use_stdin = strcmp(file_name, "-") == 0;
+	ds->remaining = SIZE_MAX;
+
+	// open the file for reading
+	ds->fd = ds->use_stdin ? STDIN_FILENO : open(file_name, O_RDONLY);
+	if (ds->fd < 0) {
+		fprintf(stderr, "Unable to open %s for reading\n", file_name);
+		free(ds);
+		return NULL;
+	}
+
+	// the buffer holds the part of the file not yet parsed; it grows only if a single
+	// line does not fit in it
+	ds->buf_size = READ_CHUNK;
+	ds->buf = (char *)malloc(ds->buf_size + 1);		// plus a newline after the last line
+	if (!ds->buf) {
+		fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) ds->buf_size + 1);
+		data_stream_close(ds);
+		return NULL;
+	}
+	return ds;
+}
+
+/*
+ * Open a data file, as data_stream_open does, to read the values between two points
+ * in it; the values before the first (already read some other time) are skipped
+ * without being read, and anything after the second (perhaps being added to the
+ * file as it is read) is left for another time.
+ *
+ * Parameters:
+ * 		in: file_name - the name of the file to read
+ *		in: offset - where in the file to start, at the beginning of a line
+ *		in: end - where to stop, at the beginning of a line (SIZE_MAX for the end
+ *				of the file)
+ *
+ * Returns:
+ *		The stream, which must be closed with data_stream_close, or NULL (an error
+ *		message has been printed).
+ */
+DataStream *data_stream_open_at(const char *file_name, size_t offset, size_t end)
+{
+	DataStream *ds = data_stream_open(file_name);
+	if (ds && offset > 0 && lseek(ds->fd, (off_t)offset, SEEK_SET) < 0) {
+		fprintf(stderr, "Unable to find byte %ld of %s\n", (long) offset, file_name);
+		data_stream_close(ds);
+		return NULL;
+	}
+	if (ds && end != SIZE_MAX) {
+		ds->remaining = end > offset ? end - offset : 0;
+	}
+	return ds;
+}
+
+/*
+ * Read the next values from a data file, one per line.  The file is read
+ * READ_CHUNK bytes at a time and the lines are parsed where they are in the buffer.
+ *
+ * Parameters:
+ *		in/out: ds - the stream
+ *		out: values - space for the values
+ *		in: max - the most values to read
+ *
+ * Returns:
+ *		The number of values stored, which is less than max only at the end of the
+ *		file or if there is an error.  ds->error is set (and a message printed) for
+ *		an error.
+ */
+size_t data_stream_read(DataStream *ds, double *values, size_t max)
+{
+	size_t got = 0;
+	while (got < max && !ds->error) {
+		// parse the complete lines already in the buffer
+		char *line = ds->buf + ds->start;
+		char *end = ds->buf + ds->len;
+		char *nl;
+		while (got < max && (nl = (char *)memchr(line, '\n', (size_t)(end - line))) != NULL) {
+			*nl = '\0';
+			if (parse_double(line, &values[got]) == line) {
+				fprintf(stderr, "Line %ld of %s does not contain a valid floating point number\n",
+						(long) (ds->line + 1), ds->file_name);
+				ds->error = true;
+				break;
+			}
+			got++;
+			ds->line++;
+			line = nl + 1;
+		}
+		ds->start = (size_t)(line - ds->buf);
+		if (got == max || ds->error || ds->at_end) {
+			break;
+		}
+
+		// keep the partial line and read more after it
+		ds->len -= ds->start;
+		memmove(ds->buf, ds->buf + ds->start, ds->len);
+		ds->start = 0;
+		if (ds->len == ds->buf_size) {
+			// one line fills the whole buffer, make room for more of it
+			char *bigger = (char *)realloc(ds->buf, ds->buf_size * 2 + 1);
+			if (!bigger) {
+				fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) ds->buf_size * 2 + 1);
+				ds->error = true;
+				break;
+			}
+			ds->buf = bigger;
+			ds->buf_size *= 2;
+		}
+
+		size_t want = ds->buf_size - ds->len;
+		if (want > ds->remaining) {
+			want = ds->remaining;
+		}
+		ssize_t n = want > 0 ? read(ds->fd, ds->buf + ds->len, want) : 0;
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Unable to read values from %s\n", ds->file_name);
+			ds->error = true;
+			break;
+		}
+		if (n == 0) {
+			// the last line may not end with a newline
+			ds->at_end = true;
+			if (ds->len > 0)
+				ds->buf[ds->len++] = '\n';
+		}
+		ds->len += (size_t)n;
+		ds->remaining -= (size_t)n;
+	}
+	return got;
+}
+
+void data_stream_close(DataStream *ds)
+{
+	if (ds) {
+		if (!ds->use_stdin && ds->fd >= 0)
+			close(ds->fd);
+		free(ds->buf);
+		free(ds);
+	}
+}
+
+/*
+ * Read a file.  The file is expected to contain a series of floating point values, one
+ * to a line.  Space is allocated for the values in the form of an array of doubles.
+ *
+ * The file is read once, through a DataStream, and the array grows as values are
+ * found, so the file does not need to be read twice to count its lines first.
+ * That also means it can be a pipe: a file name of "-" reads the standard input.
+ *
+ * If use_data_cache is set, the values of a regular file are also saved in a cache
+ * file next to it (see datacache.h).  While the data file is unchanged, later reads
+ * map the cache, and check it against its checksum, instead of parsing the file
+ * again.
+ *
+ * Parameters:
+ * 		in: file_name - the name of the file to read, or "-" for the standard input
+ *		out: size - the number of values read
+ *
+ * Returns:
+ *		A pointer to an array of double values, which must be given back with
+ *		release_file.
+ *		Returns NULL and an error message is printed to stderr if an error is encountered.
+ */
+double *read_file(const char *file_name, size_t *size)
+{
+	*size = 0;
+	DataStream *ds = data_stream_open(file_name);
+	if (!ds) {
+		return NULL;
+	}
+
+	// a regular file may have a cache of its values from an earlier run
+	struct stat st;
+	bool regular = !ds->use_stdin && fstat(ds->fd, &st) == 0 && S_ISREG(st.st_mode);
+	if (regular) {
+		double *cached = cache_load(file_name, &st, size);
+		if (cached) {
+			data_stream_close(ds);
+			return cached;
+		}
+	}
+
+	// read straight into the array, doubling it whenever it fills up
+	ValueArray a = { NULL, 0, INITIAL_VALUES / 2 };
+	bool have_error = false;
+	do {
+		size_t cap = a.cap * 2;
+		double *values = (double *)realloc(a.values, cap * sizeof(double));
+		if (!values) {
+			fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) (cap * sizeof(double)));
+			have_error = true;
+			break;
+		}
+		a.values = values;
+		a.cap = cap;
+		a.count += data_stream_read(ds, a.values + a.count, a.cap - a.count);
+		have_error = ds->error;
+	} while (!have_error && a.count == a.cap);
+	data_stream_close(ds);
+
+	// check for an error - if there was an error parsing the file, free the space and return NULL
+	if (have_error) {
+		free(a.values);
+		return NULL;
+	}
+
+	if (regular) {
+		cache_store(file_name, &st, a.values, a.count);
+	}
+	*size = a.count;
+	return a.values;
+}
+
+// one newline-aligned piece of a mapped file, parsed by whichever thread takes it
+typedef struct chunk_struct {
+	const char *start;
+	const char *end;
+	ValueArray a;				// the values parsed from the chunk
+	bool bad_line;				// a line did not hold a number; it is line a.count + 1
+	bool no_memory;
+} Chunk;
+
+// work shared by the threads of read_file_parallel
+typedef struct chunk_work_struct {
+	Chunk *chunks;
+	size_t num_chunks;
+	atomic_size_t next_chunk;	// the next chunk for a thread to take
+	atomic_bool failed;			// a chunk has failed, so the rest need not be parsed
+} ChunkWork;
+
+/*
+ * Parse the lines of a chunk into the chunk's own array.  The mapped file cannot
+ * be written to, so each line is copied to a null-terminated buffer first; it is
+ * not printed from here, since the line number depends on the chunks before it.
+ *
+ * Returns:
+ *		0 on success, else 1
+ */
+static int parse_chunk(Chunk *c)
+{
+	// start with room for the values if they are about ten bytes apiece
+	c->a.count = 0;
+	c->a.cap = (size_t)(c->end - c->start) / 10 + 16;
+	c->a.values = (double *)malloc(c->a.cap * sizeof(double));
+	if (!c->a.values) {
+		c->no_memory = true;
+		return 1;
+	}
+
+	char input[PARSE_LINE_SIZE];
+	const char *line = c->start;
+	while (line < c->end) {
+		const char *nl = (const char *)memchr(line, '\n', (size_t)(c->end - line));
+		if (!nl) {
+			nl = c->end;		// the last line of the file has no newline
+		}
+		size_t len = (size_t)(nl - line);
+		char *copy = len < sizeof(input) ? input : (char *)malloc(len + 1);
+		if (!copy) {
+			c->no_memory = true;
+			return 1;
+		}
+		memcpy(copy, line, len);
+		copy[len] = '\0';
+
+		double value;
+		bool ok = parse_double(copy, &value) != copy;
+		if (copy != input) {
+			free(copy);
+		}
+		if (!ok) {
+			c->bad_line = true;
+			return 1;
+		}
+		if (append_value(&c->a, value)) {
+			c->no_memory = true;
+			return 1;
+		}
+		line = nl + 1;
+	}
+	return 0;
+}
+
+/*
+ * Thread body for read_file_parallel.  Take chunks in order until they run out or
+ * one of them fails.
+ */
+static void *parse_chunks(void *arg)
+{
+	ChunkWork *work = (ChunkWork *)arg;
+	for (;;) {
+		size_t i = atomic_fetch_add(&work->next_chunk, 1);
+		if (i >= work->num_chunks || atomic_load(&work->failed)) {
+			break;
+		}
+		if (parse_chunk(&work->chunks[i])) {
+			atomic_store(&work->failed, true);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Read a file as read_file does, but with several threads.  The file is memory
+ * mapped and split into PARSE_CHUNKS_PER_THREAD chunks per thread, each ending at a
+ * newline.  The threads take the chunks in turn and parse each into an array of its
+ * own; the arrays are then copied, in order, into the one that is returned.
+ *
+ * The standard input ("-") and anything else that cannot be mapped is read by
+ * read_file instead.  Like read_file, a valid cache is used instead of the file if
+ * use_data_cache is set.
+ *
+ * Parameters:
+ * 		in: file_name - the name of the file to read, or "-" for the standard input
+ *		out: size - the number of values read
+ *		in: threads - the number of threads to use
+ *
+ * Returns:
+ *		A pointer to an array of double values, which must be given back with
+ *		release_file.
+ *		Returns NULL and an error message is printed to stderr if an error is encountered.
+ */
+double *read_file_parallel(const char *file_name, size_t *size, int threads)
+{
+	*size = 0;
+	if (threads <= 1 || strcmp(file_name, "-") == 0) {
+		return read_file(file_name, size);
+	}
+
+	// open the file for reading and find out how big it is
+	int fd = open(file_name, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "Unable to open %s for reading\n", file_name);
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	size_t file_size = (size_t)st.st_size;
+	if (!S_ISREG(st.st_mode) || file_size == 0) {
+		close(fd);
+		return read_file(file_name, size);
+	}
+	double *cached = cache_load(file_name, &st, size);
+	if (cached) {
+		close(fd);
+		return cached;
+	}
+
+	// map the file into memory.  The mapping stays valid after the file is closed.
+	const char *data = (const char *)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return read_file(file_name, size);
+	}
+	madvise((void *)data, file_size, MADV_SEQUENTIAL);
+
+	// split the file into chunks that each end just after a newline
+	size_t num_chunks = (size_t)threads * PARSE_CHUNKS_PER_THREAD;
+	Chunk *chunks = (Chunk *)calloc(num_chunks, sizeof(Chunk));
+	pthread_t *ids = (pthread_t *)malloc((size_t)threads * sizeof(pthread_t));
+	if (!chunks || !ids) {
+		fprintf(stderr, "Unable to allocate memory for %ld threads\n", (long) threads);
+		free(chunks);
+		free(ids);
+		munmap((void *)data, file_size);
+		return NULL;
+	}
+	const char *end = data + file_size;
+	const char *pos = data;
+	for (size_t i=0; i<num_chunks; i++) {
+		chunks[i].start = pos;
+		const char *split = i == num_chunks - 1 ? end : data + file_size / num_chunks * (i + 1);
+		if (split <= pos) {
+			split = pos;		// the chunk before ran past this one's share, so it is empty
+		}
+		else if (split < end) {
+			// finish the line the split falls in
+			const char *nl = (const char *)memchr(split, '\n', (size_t)(end - split));
+			split = nl ? nl + 1 : end;
+		}
+		chunks[i].end = split;
+		pos = split;
+	}
+
+	ChunkWork work;
+	work.chunks = chunks;
+	work.num_chunks = num_chunks;
+	atomic_init(&work.next_chunk, 0);
+	atomic_init(&work.failed, false);
+	int started = 0;
+	for (; started < threads - 1; started++) {
+		if (pthread_create(&ids[started], NULL, parse_chunks, &work) != 0) {
+			break;
+		}
+	}
+	parse_chunks(&work);		// this thread works too
+	for (int i=0; i<started; i++) {
+		pthread_join(ids[i], NULL);
+	}
+	munmap((void *)data, file_size);
+
+	// report the first chunk that failed, numbering its lines from the file's start,
+	// or else copy the values into one array
+	size_t total = 0;
+	bool have_error = false;
+	for (size_t i=0; i<num_chunks && !have_error; i++) {
+		if (chunks[i].bad_line) {
+			fprintf(stderr, "Line %ld of %s does not contain a valid floating point number\n",
+					(long) (total + chunks[i].a.count + 1), file_name);
+			have_error = true;
+		}
+		else if (chunks[i].no_memory) {
+			fprintf(stderr, "Unable to allocate memory for the values in %s\n", file_name);
+			have_error = true;
+		}
+		total += chunks[i].a.count;
+	}
+
+	double *array = NULL;
+	if (!have_error) {
+		array = (double *)malloc((total ? total : 1) * sizeof(double));
+		if (!array) {
+			fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) (total * sizeof(double)));
+		}
+		else {
+			size_t n = 0;
+			for (size_t i=0; i<num_chunks; i++) {
+				memcpy(array + n, chunks[i].a.values, chunks[i].a.count * sizeof(double));
+				n += chunks[i].a.count;
+			}
+			*size = total;
+			cache_store(file_name, &st, array, total);
+		}
+	}
+
+	for (size_t i=0; i<num_chunks; i++) {
+		free(chunks[i].a.values);
+	}
+	free(chunks);
+	free(ids);
+	return array;
+}
+
+/*
+ * Give back an array returned by read_file or read_file_parallel, which may be
+ * allocated memory or a mapped cache file.
+ */
+void release_file(double *array)
+{
+	if (array && !cache_release(array)) {
+		free(array);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef DATAFILE_H
+#define DATAFILE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define READ_CHUNK		(1 << 20)	// bytes read from the file at a time
+#define INITIAL_VALUES	1024		// values the array starts with room for
+#define PARSE_MAX_DIGITS	19		// significant digits parse_double keeps in 64 bits
+#define PARSE_LINE_SIZE		512		// longer lines are copied to the heap to be parsed
+#define PARSE_CHUNKS_PER_THREAD	4	// chunks read_file_parallel splits the file into per thread
+
+// a data file being read a few values at a time
+typedef struct data_stream_struct {
+	const char *file_name;
+	int fd;
+	bool use_stdin;
+	char *buf;					// the part of the file read but not yet parsed
+	size_t buf_size;
+	size_t start;				// where the unparsed lines start in buf
+	size_t len;					// bytes in buf
+	size_t remaining;			// the most bytes still to be read from the file
+	size_t line;				// lines parsed so far
+	bool at_end;				// the whole file has been read into buf
+	bool error;
+} DataStream;
+
+const char *parse_double(const char *s, double *value);
+DataStream *data_stream_open(const char *file_name);
+DataStream *data_stream_open_at(const char *file_name, size_t offset, size_t end);
+size_t data_stream_read(DataStream *ds, double *values, size_t max);
+void data_stream_close(DataStream *ds);
+double *read_file(const char *file_name, size_t *size);
+double *read_file_parallel(const char *file_name, size_t *size, int threads);
+void release_file(double *array);
+
+#endif
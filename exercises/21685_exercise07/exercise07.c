@@ -1,136 +1,103 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
-#define DATA_FILE	"DataFile.txt"
-#define INPUT_SIZE	512		// reasonably large for a line containing one double
+#include <datafile.h>
+#include <datacache.h>
+#include <psort.h>
+#include <extsort.h>
+#include <format.h>
+#include <sortedstore.h>
 
-double *read_file(const char *file_name, size_t *size);
+#define DATA_FILE	"DataFile.txt"
 
 /*
  * Read a series of floating point values from a file, sort them, and display the
  * sorted values to stdout.
  *
- * Parameters: n/a
+ * Parameters:
+ *		in: argv - optional, "-j threads" to read and sort with several threads,
+ *				"-m megabytes" to sort a file too big for memory in that much memory,
+ *				"-s" to keep the values sorted in a store next to the file, so
+ *				that lines added to it later are all that is sorted next time,
+ *				"-o file" to write the sorted values to instead of stdout, "-c" to
+ *				save the parsed values in a cache next to the file and use it on
+ *				later runs (see datacache.h), then the file to read instead of
+ *				DATA_FILE ("-" for the standard input)
  *
  * Returns:
  *		0 on success, else 1
  */
 
 
-void Z2zsort(double *array, int sz) {
-    for (int i=0;i<sz-1;++i) {
-        int mn = i;
-        for (int j=i+1;j<sz;++j) {
-            if (array[mn]>array[j]) {
-                mn = j;
-            }
-        }
-        double tmp = array[i];
-        array[i] = array[mn];
-        array[mn] = tmp;
-    }
+void Z2zsort(double *array, size_t sz, int threads) {
+    sort_doubles_parallel(array, sz, threads);
 }
 
-int main(void)
+int main(int argc, char *argv[])
 {
 	size_t num;		// the number of elements in the array created by read_file
 
-	// Read in the values to sort from the data file
-	double *array = read_file(DATA_FILE, &num);
-	if (!array) {
-		// there was a problem reading the file, error message already printed
-		return 1;
+	int threads = 1;			// threads to read and sort with
+	long megabytes = 0;			// memory for an external sort, 0 to sort in memory
+	bool use_store = false;		// keep the values sorted in a store next to the file
+	const char *out_name = NULL;	// where to write the sorted values, NULL for stdout
+	const char *file_name = DATA_FILE;
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc && atol(argv[i+1]) > 0) {
+			megabytes = atol(argv[++i]);
+		} else if (strcmp(argv[i], "-s") == 0) {
+			use_store = true;
+		} else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			out_name = argv[++i];
+		} else if (strcmp(argv[i], "-c") == 0) {
+			use_data_cache = true;
+		} else if (i == argc - 1 && (argv[i][0] != '-' || argv[i][1] == '\0')) {
+			file_name = argv[i];
+		} else {
+			fprintf(stderr, "Usage: %s [-j threads] [-m megabytes] [-s] [-o output] [-c] [file]\n", argv[0]);
+			return 1;
+		}
 	}
 
-	/*******************  Add your code here *********************/
-
-    Z2zsort(array, num); // array+begin, end
-    for (size_t i=0;i<num;++i) {
-        printf("%f\n", array[i]);
-    }
-
-	/*************************************************************/
-
-	// free the array (memory allocated by read_file)
-	free(array);
-
-	return 0;
-}
-
-/*
- * Read a file.  The file is expected to contain a series of floating point values, one
- * to a line.  Space is allocated for the values in the form of an array of doubles.
- * Memory for the array must be freed by the caller.
- *
- * Parameters:
- * 		in: file_name - the name of the file to read
- *		in: pointer to a value in which to store the number of values read
- *
- * Returns:
- *		A pointer to an array of double values.
- *		Returns NULL and an error message is printed to stderr if an error is encountered.
- */
-double *read_file(const char *file_name, size_t *size)
-{
-	// open the file for reading
-	FILE *fp = fopen(file_name, "r");
-	if (fp == NULL) {
-		fprintf(stderr, "Unable to open %s for reading\n", file_name);
-		return NULL;
+	if (megabytes > 0) {
+		return external_sort(file_name, out_name, (size_t)megabytes << 20, threads);
 	}
 
-	// Determine the number of lines in the file (and therefore the number of double
-	// values, since the file is expected to have one value per line) by counting
-	// the lines.  We need to know this so we can allocated an appropriate sized
-	// array for the values.
-	char input[INPUT_SIZE];		// space to store the line read from the file
-	int num = 0;				// number of items read
-	// fgets returns NULL at end of file or if there is an error
-	while(fgets(input, INPUT_SIZE, fp) != NULL) {
-		num ++;
+	FILE *out = stdout;
+	if (out_name && strcmp(out_name, "-") != 0) {
+		out = fopen(out_name, "w");
+		if (!out) {
+			fprintf(stderr, "Unable to open %s for writing\n", out_name);
+			return 1;
+		}
 	}
-	rewind(fp);	// move the file pointer back to the start of the file
-
-	// returning the number of values in the file
-	*size = num;
 
-	// Allocate space for the contents of the file.  The size to allocate is the number
-	// of values in the file multiply by the size, in bytes, of each item (in this case,
-	// we are storing doubles in the array)
-	double *array = (double *)malloc(num * sizeof(double));
-	if(!array) {
-		fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) num);
-		return NULL;
+	// Read in the values to sort from the data file (already sorted, from a store)
+	double *array = use_store ? sorted_store_read(file_name, &num, threads)
+			: read_file_parallel(file_name, &num, threads);
+	if (!array) {
+		// there was a problem reading the file, error message already printed
+		if (out != stdout)
+			fclose(out);
+		return 1;
 	}
 
-	// Read the file one line at a time and parse the value from the line using sscanf.
-	int i;
-	bool have_error = false;
-	for (i=0; i<num && !have_error; i++) {
-		// Get the line and put it into a string
-		if(fgets(input, INPUT_SIZE, fp) == NULL) {
-			fprintf(stderr, "Unable to read values from %s\n", DATA_FILE);
-			have_error = true;
-		}
-		// Parse the value from the input line and store it in the array.
-		// sscanf returns the number of values in the string that match the pattern it is given,
-		// in this case "%lf" for one double value.
-		if(sscanf(input, "%lf", &array[i]) != 1) {
-			fprintf(stderr, "Line %d of %s does not contain a valid floating point number\n", i+1, DATA_FILE);
-			have_error = true;
-		}
-	}
+	/*******************  Add your code here *********************/
 
-	// close the input file
-	fclose(fp);
+    if (!use_store)
+        Z2zsort(array, num, threads); // array+begin, end
+    int result = write_values(fileno(out), array, num, 6, threads);
 
-	// check for an error - if there was an error parsing the file, free the space and return NULL
-	if (have_error) {
-		free(array);
-		array = NULL;
-		*size = 0;
-	}
+	/*************************************************************/
+
+	// give back the array (allocated or mapped by read_file)
+	release_file(array);
+	if (out != stdout)
+		fclose(out);
 
-    return array;
+	return result;
 }
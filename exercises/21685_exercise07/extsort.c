@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <datafile.h>
+#include <psort.h>
+#include <extsort.h>
+#include <format.h>
+
+/*
+ * External merge sort, for data files with more values than fit in memory.  The
+ * values are read a memory load at a time; each load is sorted and written to a
+ * temporary file as raw doubles (a run).  The runs are then merged, EXTSORT_MAX_FANIN
+ * at a time, with a loser tree, and the last merge writes the values as text.
+ *
+ * The temporary files are made in $TMPDIR (or /tmp) and unlinked as soon as they are
+ * opened, so they disappear however the program ends.
+ */
+
+// a sorted run in a temporary file
+typedef struct run_struct {
+	int fd;
+	size_t count;
+} Run;
+
+// a run being merged: its next values are in buf[pos..len)
+typedef struct run_reader_struct {
+	int fd;
+	off_t offset;				// where the next read starts
+	size_t remaining;			// values not yet read from the file
+	double *buf;
+	size_t cap;
+	size_t pos;
+	size_t len;
+} RunReader;
+
+// where merged values go: a new run, or text in the output file
+typedef struct value_sink_struct {
+	FormatBuffer *text;			// the output file, or NULL to write a run to fd
+	int fd;
+	double *buf;				// values not yet written to the run
+	size_t len;
+	size_t cap;
+	size_t count;				// values put so far
+	bool error;
+} ValueSink;
+
+// the same order as sort_doubles, so merged runs stay in that order
+static inline uint64_t sort_key(double d)
+{
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	return bits ^ ((uint64_t)((int64_t)bits >> 63) | (UINT64_C(1) << 63));
+}
+
+/*
+ * Make an empty temporary file, already unlinked.
+ *
+ * Returns:
+ *		The file descriptor, or -1 (an error message has been printed)
+ */
+static int temp_file(void)
+{
+	const char *dir = getenv("TMPDIR");
+	if (!dir || !*dir) {
+		dir = "/tmp";
+	}
+	char name[4096];
+	snprintf(name, sizeof(name), "%s/extsort.XXXXXX", dir);
+	int fd = mkstemp(name);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to create a temporary file in %s\n", dir);
+		return -1;
+	}
+	unlink(name);
+	return fd;
+}
+
+static bool write_all(int fd, const void *data, size_t size)
+{
+	const char *p = (const char *)data;
+	while (size > 0) {
+		ssize_t done = write(fd, p, size);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			return false;
+		}
+		p += done;
+		size -= (size_t)done;
+	}
+	return true;
+}
+
+static void sink_flush(ValueSink *s)
+{
+	if (!s->text && s->len > 0 && !s->error) {
+		if (!write_all(s->fd, s->buf, s->len * sizeof(double))) {
+			fprintf(stderr, "Unable to write a temporary file\n");
+			s->error = true;
+		}
+	}
+	s->len = 0;
+}
+
+static inline void sink_put(ValueSink *s, double value)
+{
+	if (s->text) {
+		format_buffer_put(s->text, value, 6);
+	}
+	else {
+		s->buf[s->len++] = value;
+		if (s->len == s->cap) {
+			sink_flush(s);
+		}
+	}
+	s->count++;
+}
+
+/*
+ * Refill a run reader's buffer from its file.
+ *
+ * Returns:
+ *		false if the run is finished or cannot be read (then error is set)
+ */
+static bool reader_fill(RunReader *r, bool *error)
+{
+	if (r->remaining == 0) {
+		return false;
+	}
+	size_t want = r->remaining < r->cap ? r->remaining : r->cap;
+	size_t bytes = want * sizeof(double);
+	size_t got = 0;
+	while (got < bytes) {
+		ssize_t n = pread(r->fd, (char *)r->buf + got, bytes - got, r->offset + (off_t)got);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			fprintf(stderr, "Unable to read a temporary file\n");
+			*error = true;
+			return false;
+		}
+		got += (size_t)n;
+	}
+	r->offset += (off_t)bytes;
+	r->remaining -= want;
+	r->pos = 0;
+	r->len = want;
+	return true;
+}
+
+/*
+ * Merge runs with a loser tree.  The tree has a leaf for each run and, above them,
+ * nodes that hold the run that lost the match played there; the overall winner (the
+ * run with the smallest next value) is kept in tree[0].  After the winner's value is
+ * taken, only the matches on the path from its leaf to the root are replayed, so each
+ * value costs log2(k) comparisons and the tree never has to be rebuilt.
+ */
+typedef struct loser_tree_struct {
+	size_t k;
+	size_t *tree;				// tree[1..k-1] are the losers, tree[0] the winner
+	uint64_t *key;				// the key of each run's next value
+	bool *done;					// the run has no more values
+} LoserTree;
+
+// whether run a's next value comes before run b's; ties go to the earlier run
+static inline bool beats(const LoserTree *lt, size_t a, size_t b)
+{
+	if (lt->done[a] || lt->done[b]) {
+		return !lt->done[a];
+	}
+	return lt->key[a] < lt->key[b] || (lt->key[a] == lt->key[b] && a < b);
+}
+
+// play the matches below a node; the leaves are nodes k to 2k-1
+static size_t play(LoserTree *lt, size_t node)
+{
+	if (node >= lt->k) {
+		return node - lt->k;
+	}
+	size_t left = play(lt, 2 * node);
+	size_t right = play(lt, 2 * node + 1);
+	if (beats(lt, left, right)) {
+		lt->tree[node] = right;
+		return left;
+	}
+	lt->tree[node] = left;
+	return right;
+}
+
+// replay the matches above run w, whose next value has changed
+static void replay(LoserTree *lt, size_t w)
+{
+	for (size_t node = (w + lt->k) / 2; node >= 1; node /= 2) {
+		if (beats(lt, lt->tree[node], w)) {
+			size_t t = lt->tree[node];
+			lt->tree[node] = w;
+			w = t;
+		}
+	}
+	lt->tree[0] = w;
+}
+
+/*
+ * Merge k runs into a sink.
+ *
+ * Parameters:
+ *		in: runs, k - the runs to merge
+ *		in: memory - bytes to use for the run buffers
+ *		in/out: sink - where the values go
+ *
+ * Returns:
+ *		0 on success, else 1 (an error message has been printed)
+ */
+static int merge_runs(const Run *runs, size_t k, size_t memory, ValueSink *sink)
+{
+	size_t cap = memory / sizeof(double) / k;
+	if (cap < EXTSORT_MIN_BUFFER) {
+		cap = EXTSORT_MIN_BUFFER;
+	}
+	RunReader *readers = (RunReader *)calloc(k, sizeof(RunReader));
+	double *bufs = (double *)malloc(k * cap * sizeof(double));
+	LoserTree lt;
+	lt.k = k;
+	lt.tree = (size_t *)malloc(k * sizeof(size_t));
+	lt.key = (uint64_t *)malloc(k * sizeof(uint64_t));
+	lt.done = (bool *)malloc(k * sizeof(bool));
+	bool error = false;
+	if (!readers || !bufs || !lt.tree || !lt.key || !lt.done) {
+		fprintf(stderr, "Unable to allocate memory to merge %ld runs\n", (long) k);
+		error = true;
+	}
+
+	for (size_t i=0; i<k && !error; i++) {
+		RunReader *r = &readers[i];
+		r->fd = runs[i].fd;
+		r->remaining = runs[i].count;
+		r->buf = bufs + i * cap;
+		r->cap = cap;
+		lt.done[i] = !reader_fill(r, &error);
+		if (!lt.done[i]) {
+			lt.key[i] = sort_key(r->buf[0]);
+		}
+	}
+
+	if (!error) {
+		lt.tree[0] = k == 1 ? 0 : play(&lt, 1);
+		while (!lt.done[lt.tree[0]] && !error && !sink->error) {
+			size_t w = lt.tree[0];
+			RunReader *r = &readers[w];
+			sink_put(sink, r->buf[r->pos++]);
+			if (r->pos == r->len && !reader_fill(r, &error)) {
+				lt.done[w] = true;
+			}
+			else {
+				lt.key[w] = sort_key(r->buf[r->pos]);
+			}
+			if (k > 1) {
+				replay(&lt, w);
+			}
+		}
+	}
+	sink_flush(sink);
+
+	free(readers);
+	free(bufs);
+	free(lt.tree);
+	free(lt.key);
+	free(lt.done);
+	return error || sink->error;
+}
+
+/*
+ * Read a data file, sort its values and write them to the output file, one to a
+ * line, using no more than about the given amount of memory.  If all the values fit
+ * in memory they are sorted there; otherwise they are sorted in runs and merged.
+ *
+ * Parameters:
+ *		in: in_name - the data file ("-" for the standard input)
+ *		in: out_name - the output file, or NULL or "-" for the standard output
+ *		in: memory - bytes of memory to use for values
+ *		in: threads - threads to sort each run with
+ *
+ * Returns:
+ *		0 on success, else 1 (an error message has been printed)
+ */
+int external_sort(const char *in_name, const char *out_name, size_t memory, int threads)
+{
+	size_t run_cap = memory / EXTSORT_BYTES_PER_VALUE;
+	if (run_cap < EXTSORT_MIN_BUFFER) {
+		run_cap = EXTSORT_MIN_BUFFER;
+	}
+#ifdef M_MMAP_THRESHOLD
+	// glibc raises its mmap threshold as big blocks are freed, and then keeps
+	// the next run's freed sort space in the heap on top of the memory allowed
+	mallopt(M_MMAP_THRESHOLD, READ_CHUNK);
+#endif
+	double *values = (double *)malloc(run_cap * sizeof(double));
+	if (!values) {
+		fprintf(stderr, "Unable to allocate %ld bytes for the values\n", (long) (run_cap * sizeof(double)));
+		return 1;
+	}
+	DataStream *ds = data_stream_open(in_name);
+	if (!ds) {
+		free(values);
+		return 1;
+	}
+
+	bool to_stdout = !out_name || strcmp(out_name, "-") == 0;
+	FILE *out = to_stdout ? stdout : fopen(out_name, "w");
+	if (!out) {
+		fprintf(stderr, "Unable to open %s for writing\n", out_name);
+		data_stream_close(ds);
+		free(values);
+		return 1;
+	}
+	FormatBuffer *text = format_buffer_new(fileno(out));
+	if (!text) {
+		if (!to_stdout) {
+			fclose(out);
+		}
+		data_stream_close(ds);
+		free(values);
+		return 1;
+	}
+
+	// make the runs.  A run's fd is -1 once it has been closed.
+	Run *runs = NULL;
+	size_t num_runs = 0;
+	bool error = false;
+	bool in_memory = false;
+	for (;;) {
+		size_t n = data_stream_read(ds, values, run_cap);
+		if (ds->error) {
+			error = true;
+			break;
+		}
+		if (n == 0) {
+			break;
+		}
+		sort_doubles_parallel(values, n, threads);
+
+		if (num_runs == 0 && n < run_cap) {
+			// everything fits in memory, so there is nothing to merge
+			error = write_values(text->fd, values, n, 6, threads) != 0;
+			in_memory = true;
+			break;
+		}
+
+		Run *more = (Run *)realloc(runs, (num_runs + 1) * sizeof(Run));
+		if (!more) {
+			fprintf(stderr, "Unable to allocate memory for %ld runs\n", (long) num_runs + 1);
+			error = true;
+			break;
+		}
+		runs = more;
+		int fd = temp_file();
+		if (fd < 0) {
+			error = true;
+			break;
+		}
+		runs[num_runs].fd = fd;
+		runs[num_runs].count = n;
+		num_runs++;
+		if (!write_all(fd, values, n * sizeof(double))) {
+			fprintf(stderr, "Unable to write a temporary file\n");
+			error = true;
+			break;
+		}
+		if (n < run_cap) {
+			break;
+		}
+	}
+	data_stream_close(ds);
+	free(values);		// the merge buffers take the place of the values
+	size_t merge_memory = run_cap * sizeof(double);
+	size_t made = num_runs;		// runs that may need closing if there is an error
+
+	// merge groups of runs into longer ones until one merge can take them all
+	while (!error && !in_memory && num_runs > EXTSORT_MAX_FANIN) {
+		size_t merged = 0;
+		for (size_t i=0; i<num_runs && !error; i+=EXTSORT_MAX_FANIN) {
+			size_t k = num_runs - i < EXTSORT_MAX_FANIN ? num_runs - i : EXTSORT_MAX_FANIN;
+			double *buf = (double *)malloc(EXTSORT_MIN_BUFFER * sizeof(double));
+			int fd = buf ? temp_file() : -1;
+			if (fd < 0) {
+				free(buf);
+				error = true;
+				break;
+			}
+			ValueSink sink = { NULL, fd, buf, 0, EXTSORT_MIN_BUFFER, 0, false };
+			error = merge_runs(runs + i, k, merge_memory, &sink) != 0;
+			free(buf);
+			for (size_t j=i; j<i+k; j++) {
+				close(runs[j].fd);
+				runs[j].fd = -1;
+			}
+			runs[merged].fd = fd;
+			runs[merged].count = sink.count;
+			merged++;
+		}
+		num_runs = merged;
+	}
+
+	if (!error && !in_memory && num_runs > 0) {
+		ValueSink sink = { text, -1, NULL, 0, 0, 0, false };
+		error = merge_runs(runs, num_runs, merge_memory, &sink) != 0;
+	}
+	for (size_t i=0; i<made; i++) {
+		if (runs[i].fd >= 0) {
+			close(runs[i].fd);
+		}
+	}
+	free(runs);
+
+	if (!format_buffer_flush(text)) {
+		error = true;
+	}
+	format_buffer_free(text);
+	if (!to_stdout) {
+		fclose(out);
+	}
+	return error ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EXTSORT_MAX_FANIN		256		// runs merged at once; more take extra merge passes
+#define EXTSORT_MIN_BUFFER		4096	// values buffered for each run while merging
+
+// memory a run takes for each value: the value, and the copy and 16-bit bucket
+// number sort_doubles_parallel keeps while sorting it
+#define EXTSORT_BYTES_PER_VALUE	(2 * sizeof(double) + sizeof(uint16_t))
+
+int external_sort(const char *in_name, const char *out_name, size_t memory, int threads);
+
+#endif
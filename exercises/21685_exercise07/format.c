@@ -0,0 +1,611 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+
+#include <format.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX	1024		// the POSIX minimum is 16; Linux allows 1024
+#endif
+
+static const uint64_t pow10_u64[] = {
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+	100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+	10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+	100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull
+};
+
+// write x in decimal, returning the number of digits
+static int u128_digits(unsigned __int128 x, char *buf)
+{
+	char tmp[40];
+	int n = 0;
+	do {
+		tmp[n++] = (char)('0' + (int)(x % 10));
+		x /= 10;
+	} while (x > 0);
+	for (int i=0; i<n; i++) {
+		buf[i] = tmp[n - 1 - i];
+	}
+	return n;
+}
+
+/*
+ * Format a double as printf's "%.*f" does, with the same (exact, round half to
+ * even) result.  The value is a 53 bit integer times a power of two, so multiplying
+ * it by 10^precision and rounding takes only 128-bit integer arithmetic.  Values too
+ * large for that (above about 2^75), infinities, NaNs and precisions above 19 are
+ * left to snprintf.  A precision above FORMAT_MAX_PRECISION is taken as
+ * FORMAT_MAX_PRECISION, so that the largest double (309 digits before the point)
+ * still fits in FORMAT_MAX_CHARS with its newline.
+ *
+ * Parameters:
+ *		in: value - the value to format
+ *		in: precision - digits after the decimal point, at most FORMAT_MAX_PRECISION
+ *		out: buf - space for at least FORMAT_MAX_CHARS characters
+ *
+ * Returns:
+ *		The number of characters written (no null is added)
+ */
+int format_fixed(double value, int precision, char *buf)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	int biased = (int)((bits >> 52) & 0x7ff);
+	uint64_t fraction = bits & ((UINT64_C(1) << 52) - 1);
+	uint64_t m = biased ? fraction | (UINT64_C(1) << 52) : fraction;
+	int e = biased ? biased - 1075 : -1074;
+	if (precision > FORMAT_MAX_PRECISION) {
+		precision = FORMAT_MAX_PRECISION;
+	}
+	if (biased == 0x7ff || precision < 0 || precision > 19 || e > 75) {
+		return snprintf(buf, FORMAT_MAX_CHARS, "%.*f", precision, value);
+	}
+
+	// the value times 10^precision, rounded to an integer
+	uint64_t p10 = pow10_u64[precision];
+	unsigned __int128 int_part, frac_part;
+	if (e >= 0) {
+		int_part = (unsigned __int128)m << e;
+		frac_part = 0;
+	}
+	else {
+		unsigned __int128 q = 0;
+		int s = -e;
+		if (s < 128) {
+			// below 2^-127 the product is less than a half and rounds to zero
+			unsigned __int128 product = (unsigned __int128)m * p10;
+			unsigned __int128 half = (unsigned __int128)1 << (s - 1);
+			unsigned __int128 rest = product & ((half << 1) - 1);
+			q = product >> s;
+			if (rest > half || (rest == half && (q & 1))) {
+				q++;
+			}
+		}
+		int_part = q / p10;
+		frac_part = q % p10;
+	}
+
+	int len = 0;
+	if (bits >> 63) {
+		buf[len++] = '-';
+	}
+	len += u128_digits(int_part, buf + len);
+	if (precision > 0) {
+		buf[len++] = '.';
+		uint64_t f = (uint64_t)frac_part;
+		for (int i=precision-1; i>=0; i--) {
+			buf[len + i] = (char)('0' + f % 10);
+			f /= 10;
+		}
+		len += precision;
+	}
+	return len;
+}
+
+/*
+ * The shortest decimal form of a double, by Grisu2 (Florian Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers").  The value and its
+ * neighbours' midpoints are scaled by a cached power of ten so that digits can be
+ * generated with 64-bit integers until the result is inside the interval that reads
+ * back as the same double.  The text always reads back exactly, and it is the
+ * shortest that does for all but a tiny fraction of doubles.
+ */
+
+// a floating point number with a 64-bit significand: f * 2^e
+typedef struct diy_fp_struct {
+	uint64_t f;
+	int e;
+} DiyFp;
+
+#define DP_HIDDEN_BIT	(UINT64_C(1) << 52)
+
+// normalized 10^k for k = -348, -340, ... 340
+static const uint64_t cached_f[] = {
+	0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76,
+	0xcf42894a5dce35ea, 0x9a6bb0aa55653b2d, 0xe61acf033d1a45df,
+	0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f, 0xbe5691ef416bd60c,
+	0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+	0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57,
+	0xc21094364dfb5637, 0x9096ea6f3848984f, 0xd77485cb25823ac7,
+	0xa086cfcd97bf97f4, 0xef340a98172aace5, 0xb23867fb2a35b28e,
+	0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+	0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126,
+	0xb5b5ada8aaff80b8, 0x87625f056c7c4a8b, 0xc9bcff6034c13053,
+	0x964e858c91ba2655, 0xdff9772470297ebd, 0xa6dfbd9fb8e5b88f,
+	0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+	0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06,
+	0xaa242499697392d3, 0xfd87b5f28300ca0e, 0xbce5086492111aeb,
+	0x8cbccc096f5088cc, 0xd1b71758e219652c, 0x9c40000000000000,
+	0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+	0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068,
+	0x9f4f2726179a2245, 0xed63a231d4c4fb27, 0xb0de65388cc8ada8,
+	0x83c7088e1aab65db, 0xc45d1df942711d9a, 0x924d692ca61be758,
+	0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+	0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d,
+	0x952ab45cfa97a0b3, 0xde469fbd99a05fe3, 0xa59bc234db398c25,
+	0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece, 0x88fcf317f22241e2,
+	0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+	0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410,
+	0x8bab8eefb6409c1a, 0xd01fef10a657842c, 0x9b10a4e5e9913129,
+	0xe7109bfba19c0c9d, 0xac2820d9623bf429, 0x80444b5e7aa7cf85,
+	0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+	0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b,
+};
+static const int16_t cached_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066,
+};
+
+static inline DiyFp diy_multiply(DiyFp a, DiyFp b)
+{
+	unsigned __int128 p = (unsigned __int128)a.f * b.f;
+	uint64_t h = (uint64_t)(p >> 64);
+	uint64_t l = (uint64_t)p;
+	DiyFp r = { h + (l >> 63), a.e + b.e + 64 };	// rounded
+	return r;
+}
+
+static inline DiyFp diy_normalize(DiyFp v)
+{
+	int s = __builtin_clzll(v.f);
+	DiyFp r = { v.f << s, v.e - s };
+	return r;
+}
+
+// the cached power of ten that brings a number with binary exponent e into range
+static DiyFp cached_power(int e, int *k)
+{
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int ik = (int)dk;
+	if (dk - ik > 0.0) {
+		ik++;
+	}
+	unsigned int index = (unsigned int)((ik >> 3) + 1);
+	*k = -(-348 + (int)(index << 3));
+	DiyFp r = { cached_f[index], cached_e[index] };
+	return r;
+}
+
+static inline void grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+	while (rest < wp_w && delta - rest >= ten_kappa
+			&& (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+		buffer[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static inline int count_digits(uint32_t n)
+{
+	int d = 1;
+	while (d < 10 && n >= (uint32_t)pow10_u64[d]) {
+		d++;
+	}
+	return d;
+}
+
+static void digit_gen(DiyFp w, DiyFp mp, uint64_t delta, char *buffer, int *len, int *k)
+{
+	DiyFp one = { UINT64_C(1) << -mp.e, mp.e };
+	uint64_t wp_w = mp.f - w.f;
+	uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+	uint64_t p2 = mp.f & (one.f - 1);
+	int kappa = count_digits(p1);
+	*len = 0;
+
+	while (kappa > 0) {
+		uint32_t div = (uint32_t)pow10_u64[kappa - 1];
+		uint32_t d = p1 / div;
+		p1 %= div;
+		if (d || *len) {
+			buffer[(*len)++] = (char)('0' + d);
+		}
+		kappa--;
+		uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+		if (tmp <= delta) {
+			*k += kappa;
+			grisu_round(buffer, *len, delta, tmp, pow10_u64[kappa] << -one.e, wp_w);
+			return;
+		}
+	}
+
+	for (;;) {
+		p2 *= 10;
+		delta *= 10;
+		char d = (char)(p2 >> -one.e);
+		if (d || *len) {
+			buffer[(*len)++] = (char)('0' + d);
+		}
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < delta) {
+			*k += kappa;
+			int index = -kappa;
+			grisu_round(buffer, *len, delta, p2, one.f, wp_w * (index < 20 ? pow10_u64[index] : 0));
+			return;
+		}
+	}
+}
+
+// the digits of a positive, finite, nonzero value and its power of ten
+static void grisu2(double value, char *buffer, int *len, int *k)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	int biased = (int)((bits >> 52) & 0x7ff);
+	uint64_t significand = bits & (DP_HIDDEN_BIT - 1);
+	DiyFp v = biased ? (DiyFp){ significand + DP_HIDDEN_BIT, biased - 1075 } : (DiyFp){ significand, -1074 };
+
+	// the midpoints between v and its neighbours, with the same exponent
+	DiyFp plus = { (v.f << 1) + 1, v.e - 1 };
+	while (!(plus.f & (DP_HIDDEN_BIT << 1))) {
+		plus.f <<= 1;
+		plus.e--;
+	}
+	plus.f <<= 64 - 52 - 2;
+	plus.e -= 64 - 52 - 2;
+	DiyFp minus = v.f == DP_HIDDEN_BIT ? (DiyFp){ (v.f << 2) - 1, v.e - 2 } : (DiyFp){ (v.f << 1) - 1, v.e - 1 };
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	DiyFp c_mk = cached_power(plus.e, k);
+	DiyFp w = diy_multiply(diy_normalize(v), c_mk);
+	DiyFp wp = diy_multiply(plus, c_mk);
+	DiyFp wm = diy_multiply(minus, c_mk);
+	wm.f++;
+	wp.f--;
+	digit_gen(w, wp, wp.f - wm.f, buffer, len, k);
+}
+
+static int write_exponent(int k, char *buf)
+{
+	int len = 0;
+	if (k < 0) {
+		buf[len++] = '-';
+		k = -k;
+	}
+	else {
+		buf[len++] = '+';
+	}
+	return len + u128_digits((unsigned __int128)k, buf + len);
+}
+
+/*
+ * Format a double in the fewest digits that read back as the same double (see
+ * grisu2).  Numbers from 1e-6 up to 1e21 are written without an exponent, others
+ * as for example 1.5e+300; whole numbers end in ".0" so they still read as doubles.
+ *
+ * Parameters:
+ *		in: value - the value to format
+ *		out: buf - space for at least FORMAT_MAX_CHARS characters
+ *
+ * Returns:
+ *		The number of characters written (no null is added)
+ */
+int format_shortest(double value, char *buf)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	if (((bits >> 52) & 0x7ff) == 0x7ff) {
+		return snprintf(buf, FORMAT_MAX_CHARS, "%g", value);
+	}
+	int len = 0;
+	if (bits >> 63) {
+		buf[len++] = '-';
+		value = -value;
+	}
+	if (value == 0) {
+		memcpy(buf + len, "0.0", 3);
+		return len + 3;
+	}
+
+	char *b = buf + len;
+	int length, k;
+	grisu2(value, b, &length, &k);
+	int kk = length + k;		// 10^(kk-1) <= value < 10^kk
+	if (k >= 0 && kk <= 21) {
+		// 1234e7 -> 12340000000.0
+		memset(b + length, '0', (size_t)k);
+		b[kk] = '.';
+		b[kk + 1] = '0';
+		return len + kk + 2;
+	}
+	if (kk > 0 && kk <= 21) {
+		// 1234e-2 -> 12.34
+		memmove(b + kk + 1, b + kk, (size_t)(length - kk));
+		b[kk] = '.';
+		return len + length + 1;
+	}
+	if (kk > -6 && kk <= 0) {
+		// 1234e-6 -> 0.001234
+		int offset = 2 - kk;
+		memmove(b + offset, b, (size_t)length);
+		b[0] = '0';
+		b[1] = '.';
+		memset(b + 2, '0', (size_t)(offset - 2));
+		return len + length + offset;
+	}
+	if (length == 1) {
+		// 1e30
+		b[1] = 'e';
+		return len + 2 + write_exponent(kk - 1, b + 2);
+	}
+	// 1234e30 -> 1.234e+33
+	memmove(b + 2, b + 1, (size_t)(length - 1));
+	b[1] = '.';
+	b[length + 1] = 'e';
+	return len + length + 2 + write_exponent(kk - 1, b + length + 2);
+}
+
+/*
+ * Format a double with format_fixed, or with format_shortest if precision is
+ * FORMAT_SHORTEST.
+ */
+int format_value(double value, int precision, char *buf)
+{
+	if (precision == FORMAT_SHORTEST) {
+		return format_shortest(value, buf);
+	}
+	return format_fixed(value, precision, buf);
+}
+
+// write all of an array of buffers, however much each writev call takes
+static bool writev_all(int fd, struct iovec *iov, int count)
+{
+	while (count > 0) {
+		ssize_t n = writev(fd, iov, count);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		size_t done = (size_t)n;
+		while (count > 0 && done >= iov->iov_len) {
+			done -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *)iov->iov_base + done;
+			iov->iov_len -= done;
+		}
+	}
+	return true;
+}
+
+/*
+ * Make a buffer that collects formatted values and writes them to a file descriptor
+ * FORMAT_BUFFER_SIZE bytes at a time.
+ *
+ * Returns:
+ *		The buffer, to be flushed and freed with format_buffer_free, or NULL (an error
+ *		message has been printed)
+ */
+FormatBuffer *format_buffer_new(int fd)
+{
+	FormatBuffer *fb = (FormatBuffer *)calloc(1, sizeof(FormatBuffer));
+	char *buf = (char *)malloc(FORMAT_BUFFER_SIZE);
+	if (!fb || !buf) {
+		fprintf(stderr, "Unable to allocate %d bytes for the output buffer\n", FORMAT_BUFFER_SIZE);
+		free(fb);
+		free(buf);
+		return NULL;
+	}
+	fb->fd = fd;
+	fb->buf = buf;
+	fb->cap = FORMAT_BUFFER_SIZE;
+	return fb;
+}
+
+/*
+ * Add a value, and a newline, to the buffer.
+ */
+void format_buffer_put(FormatBuffer *fb, double value, int precision)
+{
+	if (fb->cap - fb->len < FORMAT_MAX_CHARS) {
+		format_buffer_flush(fb);
+	}
+	fb->len += (size_t)format_value(value, precision, fb->buf + fb->len);
+	fb->buf[fb->len++] = '\n';
+}
+
+/*
+ * Write out what the buffer holds.
+ *
+ * Returns:
+ *		true on success, false if this or an earlier write failed
+ */
+bool format_buffer_flush(FormatBuffer *fb)
+{
+	if (fb->len > 0 && !fb->error) {
+		struct iovec iov = { fb->buf, fb->len };
+		if (!writev_all(fb->fd, &iov, 1)) {
+			fprintf(stderr, "Unable to write the output\n");
+			fb->error = true;
+		}
+	}
+	fb->len = 0;
+	return !fb->error;
+}
+
+void format_buffer_free(FormatBuffer *fb)
+{
+	if (fb) {
+		free(fb->buf);
+		free(fb);
+	}
+}
+
+// one piece of the values being formatted by write_values, and its text
+typedef struct format_chunk_struct {
+	const double *values;
+	size_t n;
+	char *text;
+	size_t len;
+	size_t cap;
+	bool no_memory;
+} FormatChunk;
+
+// work shared by the threads of write_values
+typedef struct format_work_struct {
+	FormatChunk *chunks;
+	size_t num_chunks;
+	int precision;
+	atomic_size_t next_chunk;
+} FormatWork;
+
+static void *format_chunks(void *arg)
+{
+	FormatWork *work = (FormatWork *)arg;
+	for (;;) {
+		size_t i = atomic_fetch_add(&work->next_chunk, 1);
+		if (i >= work->num_chunks) {
+			break;
+		}
+		FormatChunk *c = &work->chunks[i];
+		c->len = 0;
+		for (size_t j=0; j<c->n && !c->no_memory; j++) {
+			if (c->cap - c->len < FORMAT_MAX_CHARS) {
+				char *bigger = (char *)realloc(c->text, c->cap * 2);
+				if (!bigger) {
+					c->no_memory = true;
+					break;
+				}
+				c->text = bigger;
+				c->cap *= 2;
+			}
+			c->len += (size_t)format_value(c->values[j], work->precision, c->text + c->len);
+			c->text[c->len++] = '\n';
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Write values to a file descriptor, one to a line.  With more than one thread the
+ * values are formatted FORMAT_CHUNK_VALUES at a time on each thread, into a buffer
+ * per chunk, and a round of chunks is written, in order, with one writev.
+ *
+ * Parameters:
+ *		in: fd - where to write
+ *		in: values, n - the values
+ *		in: precision - digits after the decimal point, or FORMAT_SHORTEST
+ *		in: threads - the number of threads to format with
+ *
+ * Returns:
+ *		0 on success, else 1 (an error message has been printed)
+ */
+int write_values(int fd, const double *values, size_t n, int precision, int threads)
+{
+	if (threads <= 1 || n < 2 * FORMAT_CHUNK_VALUES) {
+		FormatBuffer *fb = format_buffer_new(fd);
+		if (!fb) {
+			return 1;
+		}
+		for (size_t i=0; i<n; i++) {
+			format_buffer_put(fb, values[i], precision);
+		}
+		bool ok = format_buffer_flush(fb);
+		format_buffer_free(fb);
+		return ok ? 0 : 1;
+	}
+
+	size_t num_chunks = (size_t)threads * 2;
+	if (num_chunks > IOV_MAX) {
+		num_chunks = IOV_MAX;
+	}
+	FormatChunk *chunks = (FormatChunk *)calloc(num_chunks, sizeof(FormatChunk));
+	struct iovec *iov = (struct iovec *)malloc(num_chunks * sizeof(struct iovec));
+	pthread_t *ids = (pthread_t *)malloc((size_t)threads * sizeof(pthread_t));
+	bool error = !chunks || !iov || !ids;
+	for (size_t i=0; i<num_chunks && !error; i++) {
+		chunks[i].cap = (size_t)FORMAT_CHUNK_VALUES * 16;
+		chunks[i].text = (char *)malloc(chunks[i].cap);
+		error = !chunks[i].text;
+	}
+	if (error) {
+		fprintf(stderr, "Unable to allocate memory to format %d chunks\n", (int) num_chunks);
+	}
+
+	for (size_t done=0; done<n && !error; ) {
+		// hand out the next round of chunks
+		size_t used = 0;
+		for (; used<num_chunks && done<n; used++) {
+			size_t count = n - done < FORMAT_CHUNK_VALUES ? n - done : FORMAT_CHUNK_VALUES;
+			chunks[used].values = values + done;
+			chunks[used].n = count;
+			done += count;
+		}
+		FormatWork work;
+		work.chunks = chunks;
+		work.num_chunks = used;
+		work.precision = precision;
+		atomic_init(&work.next_chunk, 0);
+		int started = 0;
+		for (; started < threads - 1; started++) {
+			if (pthread_create(&ids[started], NULL, format_chunks, &work) != 0) {
+				break;
+			}
+		}
+		format_chunks(&work);		// this thread works too
+		for (int i=0; i<started; i++) {
+			pthread_join(ids[i], NULL);
+		}
+
+		for (size_t i=0; i<used; i++) {
+			if (chunks[i].no_memory) {
+				fprintf(stderr, "Unable to allocate memory to format the values\n");
+				error = true;
+			}
+			iov[i].iov_base = chunks[i].text;
+			iov[i].iov_len = chunks[i].len;
+		}
+		if (!error && !writev_all(fd, iov, (int)used)) {
+			fprintf(stderr, "Unable to write the output\n");
+			error = true;
+		}
+	}
+
+	for (size_t i=0; chunks && i<num_chunks; i++) {
+		free(chunks[i].text);
+	}
+	free(chunks);
+	free(iov);
+	free(ids);
+	return error ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define FORMAT_MAX_CHARS		400			// enough for any double with "%f", plus a newline
+#define FORMAT_MAX_PRECISION	80			// most digits after the point that fit in that
+#define FORMAT_BUFFER_SIZE		(1 << 20)	// bytes of text collected before a write
+#define FORMAT_CHUNK_VALUES		(1 << 15)	// values formatted by one thread at a time
+#define FORMAT_SHORTEST			-1			// precision for the shortest text that reads back exactly
+
+// text waiting to be written to a file descriptor
+typedef struct format_buffer_struct {
+	int fd;
+	char *buf;
+	size_t len;
+	size_t cap;
+	bool error;					// a write failed (a message has been printed)
+} FormatBuffer;
+
+int format_fixed(double value, int precision, char *buf);
+int format_shortest(double value, char *buf);
+int format_value(double value, int precision, char *buf);
+
+FormatBuffer *format_buffer_new(int fd);
+void format_buffer_put(FormatBuffer *fb, double value, int precision);
+bool format_buffer_flush(FormatBuffer *fb);
+void format_buffer_free(FormatBuffer *fb);
+
+int write_values(int fd, const double *values, size_t n, int precision, int threads);
+
+#endif
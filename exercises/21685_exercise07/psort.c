@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <sort.h>
+#include <psort.h>
+
+/*
+ * Parallel sample sort.  A sample of the array picks splitters that divide the
+ * values into buckets of about the same size.  Each thread then takes a block of the
+ * array, finds the bucket of each value and counts them; from the counts every
+ * thread knows where its values go, and copies them to a second array with the
+ * buckets laid out in order.  Finally each bucket is sorted by sort_doubles and
+ * copied back.
+ *
+ * The buckets are handed out by a work-stealing scheduler: each thread has a queue
+ * of buckets, largest first, and works from the front of it, so the longest sorts
+ * start first; a thread whose queue is empty takes the back (smallest) bucket from
+ * another thread's queue, which leaves the owner little to wait for.  A sample can
+ * never guarantee even buckets, but with PSORT_BUCKETS_PER_THREAD buckets per thread
+ * an uneven one only delays the thread that has it, while the others take its work.
+ */
+
+// a thread's queue of buckets to sort
+typedef struct deque_struct {
+	pthread_mutex_t lock;
+	size_t *buckets;
+	size_t head;				// the next bucket for the owner to take
+	size_t tail;				// one past the next bucket for another thread to steal
+} Deque;
+
+// everything the threads share
+typedef struct psort_struct {
+	double *array;
+	double *tmp;				// the values in bucket order
+	uint16_t *bucket_of;		// the bucket of each value
+	size_t n;
+	int threads;
+	size_t num_buckets;
+	uint64_t *splitters;		// keys that divide the buckets; num_buckets - 1 of them
+	size_t *counts;				// [thread][bucket], then where the thread's values go
+	size_t *bucket_start;		// num_buckets + 1 positions in tmp
+	Deque *deques;
+} PSort;
+
+// a thread's part in a phase of the sort
+typedef struct psort_job_struct {
+	PSort *ps;
+	int thread;
+} PSortJob;
+
+// the same order as sort_doubles, so the splitters agree with how buckets are sorted
+static inline uint64_t sort_key(double d)
+{
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	return bits ^ ((uint64_t)((int64_t)bits >> 63) | (UINT64_C(1) << 63));
+}
+
+static inline size_t block_start(const PSort *ps, int thread)
+{
+	return (size_t)((unsigned __int128)ps->n * (unsigned)thread / (unsigned)ps->threads);
+}
+
+// the number of splitters less than key, by a binary search without branches
+static inline size_t find_bucket(const uint64_t *splitters, size_t num_splitters, uint64_t key)
+{
+	const uint64_t *base = splitters;
+	size_t len = num_splitters;
+	while (len > 1) {
+		size_t half = len / 2;
+		base = base[half] < key ? base + half : base;
+		len -= half;
+	}
+	return (size_t)(base - splitters) + (*base < key);
+}
+
+/*
+ * Run fn once for each thread, threads - 1 of them on new threads and one on this
+ * one.  If a thread cannot be started (or there is no memory to keep track of the
+ * threads), its part is run here instead.
+ */
+static void run_threads(PSort *ps, void *(*fn)(void *))
+{
+	pthread_t *ids = (pthread_t *)malloc((size_t)ps->threads * sizeof(pthread_t));
+	PSortJob *jobs = (PSortJob *)malloc((size_t)ps->threads * sizeof(PSortJob));
+	bool *started = (bool *)calloc((size_t)ps->threads, sizeof(bool));
+	if (!ids || !jobs || !started) {
+		for (int t=0; t<ps->threads; t++) {
+			PSortJob job = { ps, t };
+			fn(&job);
+		}
+		free(ids);
+		free(jobs);
+		free(started);
+		return;
+	}
+	for (int t=0; t<ps->threads; t++) {
+		jobs[t].ps = ps;
+		jobs[t].thread = t;
+		started[t] = t > 0 && pthread_create(&ids[t], NULL, fn, &jobs[t]) == 0;
+	}
+	fn(&jobs[0]);
+	for (int t=1; t<ps->threads; t++) {
+		if (started[t]) {
+			pthread_join(ids[t], NULL);
+		}
+		else {
+			fn(&jobs[t]);
+		}
+	}
+	free(ids);
+	free(jobs);
+	free(started);
+}
+
+static void *classify_block(void *arg)
+{
+	PSortJob *job = (PSortJob *)arg;
+	PSort *ps = job->ps;
+	size_t *count = ps->counts + (size_t)job->thread * ps->num_buckets;
+	size_t end = block_start(ps, job->thread + 1);
+	for (size_t i=block_start(ps, job->thread); i<end; i++) {
+		size_t b = find_bucket(ps->splitters, ps->num_buckets - 1, sort_key(ps->array[i]));
+		ps->bucket_of[i] = (uint16_t)b;
+		count[b]++;
+	}
+	return NULL;
+}
+
+static void *scatter_block(void *arg)
+{
+	PSortJob *job = (PSortJob *)arg;
+	PSort *ps = job->ps;
+	size_t *pos = ps->counts + (size_t)job->thread * ps->num_buckets;
+	size_t end = block_start(ps, job->thread + 1);
+	for (size_t i=block_start(ps, job->thread); i<end; i++) {
+		ps->tmp[pos[ps->bucket_of[i]]++] = ps->array[i];
+	}
+	return NULL;
+}
+
+/*
+ * Take a bucket to sort: the first (largest) one in this thread's own queue or, if
+ * that is empty, the last (smallest) one in another's.
+ *
+ * Returns:
+ *		true if there was a bucket, false if all the queues are empty
+ */
+static bool take_bucket(PSort *ps, int thread, size_t *bucket)
+{
+	Deque *own = &ps->deques[thread];
+	pthread_mutex_lock(&own->lock);
+	bool found = own->head < own->tail;
+	if (found) {
+		*bucket = own->buckets[own->head++];
+	}
+	pthread_mutex_unlock(&own->lock);
+
+	for (int i=1; i<ps->threads && !found; i++) {
+		Deque *victim = &ps->deques[(thread + i) % ps->threads];
+		pthread_mutex_lock(&victim->lock);
+		found = victim->head < victim->tail;
+		if (found) {
+			*bucket = victim->buckets[--victim->tail];
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+	return found;
+}
+
+static void *sort_buckets(void *arg)
+{
+	PSortJob *job = (PSortJob *)arg;
+	PSort *ps = job->ps;
+	size_t b;
+	while (take_bucket(ps, job->thread, &b)) {
+		size_t start = ps->bucket_start[b];
+		size_t len = ps->bucket_start[b + 1] - start;
+		sort_doubles(ps->tmp + start, len);
+		memcpy(ps->array + start, ps->tmp + start, len * sizeof(double));
+	}
+	return NULL;
+}
+
+/*
+ * Choose the splitters from a sample of the array, taken at evenly spaced positions
+ * with a little jitter so that patterns in the data do not line up with the sample.
+ */
+static int choose_splitters(PSort *ps)
+{
+	size_t num_samples = ps->num_buckets * PSORT_OVERSAMPLE;
+	double *sample = (double *)malloc(num_samples * sizeof(double));
+	if (!sample) {
+		return 1;
+	}
+	uint64_t state = 0x9e3779b97f4a7c15ull;
+	size_t step = ps->n / num_samples;
+	for (size_t i=0; i<num_samples; i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		sample[i] = ps->array[i * step + state % step];
+	}
+	sort_doubles(sample, num_samples);
+	for (size_t i=1; i<ps->num_buckets; i++) {
+		ps->splitters[i - 1] = sort_key(sample[i * PSORT_OVERSAMPLE]);
+	}
+	free(sample);
+	return 0;
+}
+
+/*
+ * Work out where each thread's values for each bucket go, and give the threads
+ * their queues of buckets, the largest buckets first and spread round-robin.
+ */
+static void plan_buckets(PSort *ps, size_t *order)
+{
+	size_t pos = 0;
+	for (size_t b=0; b<ps->num_buckets; b++) {
+		ps->bucket_start[b] = pos;
+		for (int t=0; t<ps->threads; t++) {
+			size_t *count = &ps->counts[(size_t)t * ps->num_buckets + b];
+			size_t c = *count;
+			*count = pos;
+			pos += c;
+		}
+	}
+	ps->bucket_start[ps->num_buckets] = pos;
+
+	// insertion sort of the bucket numbers by size; there are only a few thousand
+	for (size_t b=0; b<ps->num_buckets; b++) {
+		size_t len = ps->bucket_start[b + 1] - ps->bucket_start[b];
+		size_t j = b;
+		while (j > 0 && ps->bucket_start[order[j-1] + 1] - ps->bucket_start[order[j-1]] < len) {
+			order[j] = order[j-1];
+			j--;
+		}
+		order[j] = b;
+	}
+	for (size_t i=0; i<ps->num_buckets; i++) {
+		Deque *d = &ps->deques[i % (size_t)ps->threads];
+		d->buckets[d->tail++] = order[i];
+	}
+}
+
+/*
+ * Sort an array of doubles, in the same order as sort_doubles, using several
+ * threads.  Arrays shorter than PSORT_THRESHOLD, and any array if there is not
+ * enough memory for a second copy of it, are sorted on this thread alone.
+ *
+ * Parameters:
+ *		in/out: array - the values to sort
+ *		in: n - the number of values
+ *		in: threads - the number of threads to use
+ */
+void sort_doubles_parallel(double *array, size_t n, int threads)
+{
+	if (threads <= 1 || n < PSORT_THRESHOLD) {
+		sort_doubles(array, n);
+		return;
+	}
+
+	PSort ps;
+	memset(&ps, 0, sizeof(ps));
+	ps.array = array;
+	ps.n = n;
+	ps.threads = threads;
+	ps.num_buckets = (size_t)threads * PSORT_BUCKETS_PER_THREAD;
+	if (ps.num_buckets > PSORT_MAX_BUCKETS) {
+		ps.num_buckets = PSORT_MAX_BUCKETS;
+	}
+	if (ps.num_buckets * PSORT_OVERSAMPLE > n) {
+		ps.num_buckets = n / PSORT_OVERSAMPLE;
+	}
+	// a thread without a bucket of its own would only add to the counts
+	if ((size_t)threads > ps.num_buckets) {
+		threads = (int)ps.num_buckets;
+		ps.threads = threads;
+	}
+
+	ps.tmp = (double *)malloc(n * sizeof(double));
+	ps.bucket_of = (uint16_t *)malloc(n * sizeof(uint16_t));
+	ps.splitters = (uint64_t *)malloc(ps.num_buckets * sizeof(uint64_t));
+	ps.counts = (size_t *)calloc((size_t)threads * ps.num_buckets, sizeof(size_t));
+	ps.bucket_start = (size_t *)malloc((ps.num_buckets + 1) * sizeof(size_t));
+	ps.deques = (Deque *)calloc((size_t)threads, sizeof(Deque));
+	size_t per_queue = (ps.num_buckets + (size_t)threads - 1) / (size_t)threads;
+	size_t *queues = (size_t *)malloc(((size_t)threads * per_queue + ps.num_buckets) * sizeof(size_t));
+	if (!ps.tmp || !ps.bucket_of || !ps.splitters || !ps.counts || !ps.bucket_start
+			|| !ps.deques || !queues || choose_splitters(&ps) != 0) {
+		sort_doubles(array, n);
+	}
+	else {
+		// every queue gets room for all the buckets it could be given
+		for (int t=0; t<threads; t++) {
+			pthread_mutex_init(&ps.deques[t].lock, NULL);
+			ps.deques[t].buckets = queues + (size_t)t * per_queue;
+		}
+
+		run_threads(&ps, classify_block);
+		plan_buckets(&ps, queues + (size_t)threads * per_queue);
+		run_threads(&ps, scatter_block);
+		run_threads(&ps, sort_buckets);
+
+		for (int t=0; t<threads; t++) {
+			pthread_mutex_destroy(&ps.deques[t].lock);
+		}
+	}
+
+	free(ps.tmp);
+	free(ps.bucket_of);
+	free(ps.splitters);
+	free(ps.counts);
+	free(ps.bucket_start);
+	free(ps.deques);
+	free(queues);
+}
@@ -0,0 +1,13 @@
+#ifndef PSORT_H
+#define PSORT_H
+
+#include <stddef.h>
+
+#define PSORT_THRESHOLD			(1 << 16)	// smaller arrays are sorted on one thread
+#define PSORT_BUCKETS_PER_THREAD	16		// buckets per thread, so stealing can even out the load
+#define PSORT_MAX_BUCKETS		4096		// bucket numbers must fit in 16 bits
+#define PSORT_OVERSAMPLE		32			// samples taken per bucket to choose the splitters
+
+void sort_doubles_parallel(double *array, size_t n, int threads);
+
+#endif
@@ -0,0 +1,426 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <sort.h>
+
+/*
+ * The array is sorted as 64-bit keys made from the bits of each double, in place.
+ * The key of a positive double is its bits with the sign bit set, and the key of a
+ * negative one is all its bits flipped, so the keys compare as unsigned integers in
+ * the order
+ *
+ *		-NaN < -inf < ... < -0.0 < +0.0 < ... < +inf < +NaN
+ *
+ * which puts every double, NaNs and zeros included, in one deterministic place.
+ * The key type may alias the doubles it is made from.
+ */
+typedef uint64_t __attribute__((may_alias)) Key;
+
+#define SIGN_BIT	(UINT64_C(1) << 63)
+
+static inline Key to_key(Key bits)
+{
+	return bits ^ ((Key)((int64_t)bits >> 63) | SIGN_BIT);
+}
+
+static inline Key from_key(Key key)
+{
+	return key ^ (((key >> 63) - 1) | SIGN_BIT);
+}
+
+static inline void swap_keys(Key *a, Key *b)
+{
+	Key t = *a;
+	*a = *b;
+	*b = t;
+}
+
+// put a and b in order without a branch, so the sorting networks do not mispredict
+static inline void compare_swap(Key *a, Key *b)
+{
+	Key x = *a, y = *b;
+	*a = x < y ? x : y;
+	*b = x < y ? y : x;
+}
+
+static inline void sort3(Key *a, Key *b, Key *c)
+{
+	compare_swap(a, b);
+	compare_swap(b, c);
+	compare_swap(a, b);
+}
+
+/*
+ * Sort up to SORT_NETWORK_MAX keys with a fixed sorting network.  The networks are
+ * the smallest known for each size.
+ */
+static void sort_network(Key *k, size_t n)
+{
+	static const unsigned char pairs[][19][2] = {
+		{ { 0 } }, { { 0 } },
+		{ {0,1} },
+		{ {0,2}, {0,1}, {1,2} },
+		{ {0,1}, {2,3}, {0,2}, {1,3}, {1,2} },
+		{ {0,1}, {3,4}, {2,4}, {2,3}, {1,4}, {0,3}, {0,2}, {1,3}, {1,2} },
+		{ {1,2}, {4,5}, {0,2}, {3,5}, {0,1}, {3,4}, {2,5}, {0,3}, {1,4}, {2,4},
+		  {1,3}, {2,3} },
+		{ {1,2}, {3,4}, {5,6}, {0,2}, {3,5}, {4,6}, {0,1}, {4,5}, {2,6}, {0,4},
+		  {1,5}, {0,3}, {2,5}, {1,3}, {2,4}, {2,3} },
+		{ {0,1}, {2,3}, {4,5}, {6,7}, {0,2}, {1,3}, {4,6}, {5,7}, {1,2}, {5,6},
+		  {0,4}, {3,7}, {1,5}, {2,6}, {1,4}, {3,6}, {2,4}, {3,5}, {3,4} }
+	};
+	static const unsigned char count[] = { 0, 0, 1, 3, 5, 9, 12, 16, 19 };
+	for (unsigned int i=0; i<count[n]; i++) {
+		compare_swap(&k[pairs[n][i][0]], &k[pairs[n][i][1]]);
+	}
+}
+
+static void insertion_sort(Key *begin, Key *end)
+{
+	for (Key *cur = begin + 1; cur < end; cur++) {
+		Key *sift = cur;
+		Key tmp = *sift;
+		while (sift != begin && tmp < sift[-1]) {
+			*sift = sift[-1];
+			sift--;
+		}
+		*sift = tmp;
+	}
+}
+
+// insertion sort for a partition with a key no larger than all of its own before it
+static void unguarded_insertion_sort(Key *begin, Key *end)
+{
+	for (Key *cur = begin + 1; cur < end; cur++) {
+		Key *sift = cur;
+		Key tmp = *sift;
+		while (tmp < sift[-1]) {
+			*sift = sift[-1];
+			sift--;
+		}
+		*sift = tmp;
+	}
+}
+
+/*
+ * Insertion sort that gives up after moving PARTIAL_INSERTION_LIMIT keys.
+ *
+ * Returns:
+ *		true if the keys are now sorted, false if it gave up
+ */
+#define PARTIAL_INSERTION_LIMIT	8
+
+static bool partial_insertion_sort(Key *begin, Key *end)
+{
+	size_t moved = 0;
+	for (Key *cur = begin + 1; cur < end; cur++) {
+		Key *sift = cur;
+		Key tmp = *sift;
+		if (tmp < sift[-1]) {
+			while (sift != begin && tmp < sift[-1]) {
+				*sift = sift[-1];
+				sift--;
+			}
+			*sift = tmp;
+			moved += (size_t)(cur - sift);
+			if (moved > PARTIAL_INSERTION_LIMIT) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void sift_down(Key *k, size_t i, size_t n)
+{
+	Key tmp = k[i];
+	for (;;) {
+		size_t child = 2 * i + 1;
+		if (child >= n) {
+			break;
+		}
+		if (child + 1 < n && k[child] < k[child + 1]) {
+			child++;
+		}
+		if (!(tmp < k[child])) {
+			break;
+		}
+		k[i] = k[child];
+		i = child;
+	}
+	k[i] = tmp;
+}
+
+// the fallback that keeps the worst case at O(n log n)
+static void heap_sort(Key *k, size_t n)
+{
+	for (size_t i=n/2; i>0; i--) {
+		sift_down(k, i - 1, n);
+	}
+	for (size_t i=n-1; i>0; i--) {
+		swap_keys(&k[0], &k[i]);
+		sift_down(k, 0, i);
+	}
+}
+
+/*
+ * Partition around the pivot at *begin, putting keys equal to it on the right.
+ *
+ * Returns:
+ *		Where the pivot ends up; *already is set if no keys had to be swapped.
+ */
+static Key *partition_right(Key *begin, Key *end, bool *already)
+{
+	Key pivot = *begin;
+	Key *first = begin;
+	Key *last = end;
+
+	// find the first key not less than the pivot, and the last one less than it
+	while (*++first < pivot) {
+	}
+	if (first - 1 == begin) {
+		while (first < last && !(*--last < pivot)) {
+		}
+	}
+	else {
+		while (!(*--last < pivot)) {
+		}
+	}
+
+	*already = first >= last;
+	while (first < last) {
+		swap_keys(first, last);
+		while (*++first < pivot) {
+		}
+		while (!(*--last < pivot)) {
+		}
+	}
+
+	Key *pivot_pos = first - 1;
+	*begin = *pivot_pos;
+	*pivot_pos = pivot;
+	return pivot_pos;
+}
+
+/*
+ * Partition around the pivot at *begin, putting keys equal to it on the left.  This
+ * is used when the pivot equals the key before the partition, so every key equal to
+ * it is in its final place and only the right side is left to sort.
+ */
+static Key *partition_left(Key *begin, Key *end)
+{
+	Key pivot = *begin;
+	Key *first = begin;
+	Key *last = end;
+
+	while (pivot < *--last) {
+	}
+	if (last + 1 == end) {
+		while (first < last && !(pivot < *++first)) {
+		}
+	}
+	else {
+		while (!(pivot < *++first)) {
+		}
+	}
+
+	while (first < last) {
+		swap_keys(first, last);
+		while (pivot < *--last) {
+		}
+		while (!(pivot < *++first)) {
+		}
+	}
+
+	Key *pivot_pos = last;
+	*begin = *pivot_pos;
+	*pivot_pos = pivot;
+	return pivot_pos;
+}
+
+/*
+ * Pattern-defeating quicksort: quicksort with a median of three (or of nine)
+ * pivot, that
+ *	- recognises partitions that are already sorted and finishes them with an
+ *	  insertion sort that gives up quickly if they are not,
+ *	- groups runs of keys equal to a previous pivot in linear time,
+ *	- shuffles a few keys after a badly unbalanced partition to break up patterns
+ *	  that would otherwise make it quadratic, and
+ *	- switches to heap sort if that keeps happening (bad_allowed times).
+ *
+ * leftmost is false when the key before begin is no larger than every key in the
+ * partition, so it can be used as a sentinel.
+ */
+static void pdq_sort(Key *begin, Key *end, int bad_allowed, bool leftmost)
+{
+	for (;;) {
+		size_t size = (size_t)(end - begin);
+		if (size <= SORT_NETWORK_MAX) {
+			sort_network(begin, size);
+			return;
+		}
+		if (size < SORT_INSERTION_THRESHOLD) {
+			if (leftmost) {
+				insertion_sort(begin, end);
+			}
+			else {
+				unguarded_insertion_sort(begin, end);
+			}
+			return;
+		}
+
+		// choose the pivot and move it to the start
+		size_t s2 = size / 2;
+		if (size > SORT_NINTHER_THRESHOLD) {
+			sort3(begin, begin + s2, end - 1);
+			sort3(begin + 1, begin + (s2 - 1), end - 2);
+			sort3(begin + 2, begin + (s2 + 1), end - 3);
+			sort3(begin + (s2 - 1), begin + s2, begin + (s2 + 1));
+			swap_keys(begin, begin + s2);
+		}
+		else {
+			sort3(begin + s2, begin, end - 1);
+		}
+
+		if (!leftmost && !(begin[-1] < *begin)) {
+			begin = partition_left(begin, end) + 1;
+			continue;
+		}
+
+		bool already;
+		Key *pivot_pos = partition_right(begin, end, &already);
+		size_t l_size = (size_t)(pivot_pos - begin);
+		size_t r_size = (size_t)(end - (pivot_pos + 1));
+
+		if (l_size < size / 8 || r_size < size / 8) {
+			if (--bad_allowed == 0) {
+				heap_sort(begin, size);
+				return;
+			}
+			if (l_size >= SORT_INSERTION_THRESHOLD) {
+				swap_keys(begin, begin + l_size / 4);
+				swap_keys(pivot_pos - 1, pivot_pos - l_size / 4);
+				if (l_size > SORT_NINTHER_THRESHOLD) {
+					swap_keys(begin + 1, begin + (l_size / 4 + 1));
+					swap_keys(begin + 2, begin + (l_size / 4 + 2));
+					swap_keys(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
+					swap_keys(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
+				}
+			}
+			if (r_size >= SORT_INSERTION_THRESHOLD) {
+				swap_keys(pivot_pos + 1, pivot_pos + (1 + r_size / 4));
+				swap_keys(end - 1, end - r_size / 4);
+				if (r_size > SORT_NINTHER_THRESHOLD) {
+					swap_keys(pivot_pos + 2, pivot_pos + (2 + r_size / 4));
+					swap_keys(pivot_pos + 3, pivot_pos + (3 + r_size / 4));
+					swap_keys(end - 2, end - (1 + r_size / 4));
+					swap_keys(end - 3, end - (2 + r_size / 4));
+				}
+			}
+		}
+		else if (already && partial_insertion_sort(begin, pivot_pos)
+				&& partial_insertion_sort(pivot_pos + 1, end)) {
+			return;
+		}
+
+		// sort the left side by recursion and the right side by looping
+		pdq_sort(begin, pivot_pos, bad_allowed, leftmost);
+		begin = pivot_pos + 1;
+		leftmost = false;
+	}
+}
+
+/*
+ * LSD radix sort of the keys, a byte at a time.  The counts for all eight bytes are
+ * made in one pass, and a byte that is the same in every key is skipped, so keys
+ * that only differ in a few bytes take only a few passes.
+ *
+ * Returns:
+ *		0 on success, else 1 (no memory for the second buffer; the keys are unchanged)
+ */
+static int radix_sort(Key *k, size_t n)
+{
+	Key *buf = (Key *)malloc(n * sizeof(Key));
+	if (!buf) {
+		return 1;
+	}
+
+	size_t (*counts)[256] = (size_t (*)[256])calloc(8, sizeof(*counts));
+	if (!counts) {
+		free(buf);
+		return 1;
+	}
+	for (size_t i=0; i<n; i++) {
+		Key key = k[i];
+		for (int b=0; b<8; b++) {
+			counts[b][(key >> (8 * b)) & 0xff]++;
+		}
+	}
+
+	Key *from = k, *to = buf;
+	for (int b=0; b<8; b++) {
+		size_t *count = counts[b];
+		if (count[(from[0] >> (8 * b)) & 0xff] == n) {
+			continue;		// every key has the same byte here
+		}
+		// turn the counts into where each byte value starts
+		size_t pos = 0;
+		for (int v=0; v<256; v++) {
+			size_t c = count[v];
+			count[v] = pos;
+			pos += c;
+		}
+		for (size_t i=0; i<n; i++) {
+			Key key = from[i];
+			to[count[(key >> (8 * b)) & 0xff]++] = key;
+		}
+		Key *t = from;
+		from = to;
+		to = t;
+	}
+	if (from != k) {
+		memcpy(k, from, n * sizeof(Key));
+	}
+
+	free(counts);
+	free(buf);
+	return 0;
+}
+
+/*
+ * Sort an array of doubles into ascending order.  NaNs and zeros have a fixed
+ * place: negative NaNs first, then -inf up to -0.0, then +0.0 up to +inf, then
+ * positive NaNs.
+ *
+ * Arrays of SORT_RADIX_THRESHOLD values or more are radix sorted, which takes a
+ * second array as large as the first; smaller ones, or any if that array cannot be
+ * allocated, are sorted in place by pattern-defeating quicksort.
+ *
+ * Parameters:
+ *		in/out: array - the values to sort
+ *		in: n - the number of values
+ */
+void sort_doubles(double *array, size_t n)
+{
+	if (n < 2) {
+		return;
+	}
+	Key *k = (Key *)array;
+	for (size_t i=0; i<n; i++) {
+		k[i] = to_key(k[i]);
+	}
+
+	if (n < SORT_RADIX_THRESHOLD || radix_sort(k, n) != 0) {
+		int bad_allowed = 1;
+		for (size_t m=n; m>1; m>>=1) {
+			bad_allowed++;
+		}
+		pdq_sort(k, k + n, bad_allowed, true);
+	}
+
+	for (size_t i=0; i<n; i++) {
+		k[i] = from_key(k[i]);
+	}
+}
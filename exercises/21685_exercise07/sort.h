@@ -0,0 +1,13 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+
+#define SORT_RADIX_THRESHOLD	2048	// arrays at least this long are radix sorted
+#define SORT_INSERTION_THRESHOLD	24	// partitions shorter than this are insertion sorted
+#define SORT_NETWORK_MAX		8		// and ones this short go through a sorting network
+#define SORT_NINTHER_THRESHOLD	128		// partitions longer than this pick a pivot from nine
+
+void sort_doubles(double *array, size_t n);
+
+#endif
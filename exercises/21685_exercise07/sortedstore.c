@@ -0,0 +1,542 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <datafile.h>
+#include <datacache.h>
+#include <sort.h>
+#include <psort.h>
+#include <sortedstore.h>
+
+/*
+ * A data file that only ever has lines added to the end need not be sorted again
+ * from the start each time.  Its store file keeps its values sorted, as a base run
+ * and a few smaller delta runs, in the manner of a log-structured merge tree: when
+ * the data file has grown, only the new lines are parsed and sorted, in O(k log k),
+ * and written to the end of the store as a new delta.  When there are too many
+ * deltas, or they hold too many values, they are merged with the base into a new
+ * base, in O(n + k).  Searches look in every run, so they never need the runs merged.
+ *
+ * A store is only trusted if the data file is at least as long as when the store
+ * was last brought up to date, the bytes at each end of that part of it are the
+ * same, and, if the file has grown, that part ended with a newline (so the first
+ * new line is a line of its own, not the rest of the last one).  Otherwise the store
+ * is rebuilt from the whole data file: a file without a newline at the end is
+ * rebuilt each time lines are added to it, though not when it is unchanged.  The
+ * rebuild parses the file itself, without reading or writing a cache.  Like the
+ * cache, this catches a data file that has been replaced or rewritten, but not
+ * every change in the middle of one that has also grown.
+ */
+
+// the same order as sort_doubles, so merged runs stay in that order
+static inline uint64_t sort_key(double d)
+{
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	return bits ^ ((uint64_t)((int64_t)bits >> 63) | (UINT64_C(1) << 63));
+}
+
+static char *store_name(const char *file_name)
+{
+	size_t len = strlen(file_name);
+	char *name = (char *)malloc(len + sizeof(STORE_SUFFIX));
+	if (name) {
+		memcpy(name, file_name, len);
+		memcpy(name + len, STORE_SUFFIX, sizeof(STORE_SUFFIX));
+	}
+	return name;
+}
+
+static bool pwrite_all(int fd, const void *data, size_t size, off_t offset)
+{
+	const char *p = (const char *)data;
+	while (size > 0) {
+		ssize_t done = pwrite(fd, p, size, offset);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			return false;
+		}
+		p += done;
+		size -= (size_t)done;
+		offset += done;
+	}
+	return true;
+}
+
+/*
+ * Checksums of the first STORE_CHECK_BYTES bytes of the data file and of the last
+ * STORE_CHECK_BYTES before size, and whether the byte before size is a newline.
+ *
+ * Returns:
+ *		true if the bytes could be read
+ */
+static bool check_source(int fd, size_t size, uint64_t *head, uint64_t *tail, bool *whole_lines)
+{
+	char buf[STORE_CHECK_BYTES];
+	for (int end=0; end<2; end++) {
+		size_t len = size < STORE_CHECK_BYTES ? size : STORE_CHECK_BYTES;
+		off_t offset = end ? (off_t)(size - len) : 0;
+		if (pread(fd, buf, len, offset) != (ssize_t)len) {
+			return false;
+		}
+		uint64_t h = 0xcbf29ce484222325ull ^ size;
+		for (size_t i=0; i<len; i++) {
+			h = (h ^ (unsigned char)buf[i]) * 0x100000001b3ull;
+		}
+		*(end ? tail : head) = h;
+		if (end) {
+			*whole_lines = len == 0 || buf[len - 1] == '\n';
+		}
+	}
+	return true;
+}
+
+// merge two sorted arrays into out; on equal keys a's values go first
+static void merge_two(const double *a, size_t na, const double *b, size_t nb, double *out)
+{
+	size_t i = 0, j = 0, k = 0;
+	while (i < na && j < nb) {
+		out[k++] = sort_key(b[j]) < sort_key(a[i]) ? b[j++] : a[i++];
+	}
+	if (i < na) {
+		memcpy(out + k, a + i, (na - i) * sizeof(double));
+	}
+	if (j < nb) {
+		memcpy(out + k, b + j, (nb - j) * sizeof(double));
+	}
+}
+
+/*
+ * Merge sorted runs into one array.  The deltas, which are small, are merged with
+ * one another first, so the base is only copied once.
+ *
+ * Returns:
+ *		The merged values, to be freed, or NULL (an error message has been printed)
+ */
+static double *merge_all(const double *const *runs, const size_t *counts, size_t num_runs)
+{
+	double *deltas = NULL;
+	size_t num_deltas = 0;
+	for (size_t r=1; r<num_runs; r++) {
+		double *more = (double *)malloc((num_deltas + counts[r]) * sizeof(double) + 1);
+		if (!more) {
+			fprintf(stderr, "Unable to allocate memory to merge %ld values\n", (long) (num_deltas + counts[r]));
+			free(deltas);
+			return NULL;
+		}
+		merge_two(deltas, num_deltas, runs[r], counts[r], more);
+		free(deltas);
+		deltas = more;
+		num_deltas += counts[r];
+	}
+	size_t total = counts[0] + num_deltas;
+	double *out = (double *)malloc(total * sizeof(double) + 1);
+	if (!out) {
+		fprintf(stderr, "Unable to allocate %ld bytes for the values\n", (long) (total * sizeof(double)));
+	}
+	else {
+		merge_two(runs[0], counts[0], deltas, num_deltas, out);
+	}
+	free(deltas);
+	return out;
+}
+
+/*
+ * Write a whole new store, with one run, to a temporary file and rename it over the
+ * old one, so a reader never sees half of one.
+ *
+ * Returns:
+ *		true on success
+ */
+static bool write_store(const char *name, StoreHeader *h, const double *values, size_t count)
+{
+	char *temp = (char *)malloc(strlen(name) + 8);
+	if (!temp) {
+		return false;
+	}
+	sprintf(temp, "%s.XXXXXX", name);
+	int fd = mkstemp(temp);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to create %s\n", temp);
+		free(temp);
+		return false;
+	}
+	fchmod(fd, 0644);		// mkstemp makes it readable by the owner only
+
+	char header[STORE_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	h->num_runs = 1;
+	memset(h->run_count, 0, sizeof(h->run_count));
+	h->run_count[0] = count;
+	memcpy(header, h, sizeof(*h));
+	bool ok = pwrite_all(fd, header, sizeof(header), 0)
+			&& pwrite_all(fd, values, count * sizeof(double), STORE_HEADER_SIZE);
+	ok = close(fd) == 0 && ok;
+	if (!ok || rename(temp, name) != 0) {
+		fprintf(stderr, "Unable to write %s\n", name);
+		unlink(temp);
+		ok = false;
+	}
+	free(temp);
+	return ok;
+}
+
+/*
+ * Read and sort the values between two points in the data file, where there are
+ * already lines values before the first (which is only used to number lines in
+ * error messages).
+ *
+ * Returns:
+ *		The values, to be freed, or NULL (an error message has been printed)
+ */
+static double *read_new_values(const char *file_name, size_t offset, size_t end, size_t lines, size_t *count)
+{
+	DataStream *ds = data_stream_open_at(file_name, offset, end);
+	if (!ds) {
+		return NULL;
+	}
+	ds->line = lines;
+	size_t cap = INITIAL_VALUES, n = 0;
+	double *values = (double *)malloc(cap * sizeof(double));
+	while (values && !ds->error) {
+		n += data_stream_read(ds, values + n, cap - n);
+		if (n < cap || ds->error) {
+			break;
+		}
+		double *bigger = (double *)realloc(values, cap * 2 * sizeof(double));
+		if (!bigger) {
+			free(values);
+			values = NULL;
+			break;
+		}
+		values = bigger;
+		cap *= 2;
+	}
+	if (!values) {
+		fprintf(stderr, "Unable to allocate memory for the new values in %s\n", file_name);
+	}
+	else if (ds->error) {
+		free(values);
+		values = NULL;
+	}
+	data_stream_close(ds);
+	if (values) {
+		sort_doubles(values, n);
+		*count = n;
+	}
+	return values;
+}
+
+/*
+ * Map a store file that has been checked or written.
+ */
+static SortedStore *map_store(const char *name)
+{
+	int fd = open(name, O_RDONLY);
+	struct stat st;
+	StoreHeader h;
+	if (fd < 0 || fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) {
+		fprintf(stderr, "Unable to read %s\n", name);
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	SortedStore *store = (SortedStore *)calloc(1, sizeof(SortedStore));
+	void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (!store || base == MAP_FAILED) {
+		fprintf(stderr, "Unable to map %s\n", name);
+		free(store);
+		if (base != MAP_FAILED)
+			munmap(base, (size_t)st.st_size);
+		return NULL;
+	}
+	store->base = base;
+	store->length = (size_t)st.st_size;
+	store->num_runs = (size_t)h.num_runs;
+	const double *run = (const double *)((char *)base + STORE_HEADER_SIZE);
+	for (size_t r=0; r<store->num_runs; r++) {
+		store->runs[r] = run;
+		store->run_count[r] = (size_t)h.run_count[r];
+		store->n += store->run_count[r];
+		run += store->run_count[r];
+	}
+	return store;
+}
+
+/*
+ * Open the sorted store of a data file, bringing it up to date first: a missing or
+ * untrusted store is built from the whole file, and lines added to the file since
+ * the store was last opened are sorted and added to it as a delta run, or merged
+ * into its base run if the deltas have grown too many or too big.
+ *
+ * Parameters:
+ *		in: file_name - the name of the data file (not the standard input)
+ *		in: threads - the number of threads to read and sort a whole file with
+ *
+ * Returns:
+ *		The store, to be closed with sorted_store_close, or NULL (an error message
+ *		has been printed)
+ */
+SortedStore *sorted_store_open(const char *file_name, int threads)
+{
+	if (strcmp(file_name, "-") == 0) {
+		fprintf(stderr, "The standard input cannot have a sorted store\n");
+		return NULL;
+	}
+	int source = open(file_name, O_RDONLY);
+	struct stat st;
+	if (source < 0 || fstat(source, &st) != 0) {
+		fprintf(stderr, "Unable to open %s for reading\n", file_name);
+		if (source >= 0)
+			close(source);
+		return NULL;
+	}
+	size_t size = (size_t)st.st_size;
+	char *name = store_name(file_name);
+	if (!name) {
+		fprintf(stderr, "Unable to allocate memory to read %s\n", file_name);
+		close(source);
+		return NULL;
+	}
+
+	// is there a store for (the start of) this data file?
+	StoreHeader h;
+	struct stat store_st;
+	int fd = open(name, O_RDWR);
+	uint64_t head, tail;
+	bool whole_lines;
+	bool valid = fd >= 0 && fstat(fd, &store_st) == 0
+			&& pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h)
+			&& memcmp(h.magic, STORE_MAGIC, sizeof(h.magic)) == 0
+			&& h.num_runs >= 1 && h.num_runs <= STORE_MAX_RUNS
+			&& h.source_size <= size;
+	uint64_t total = 0;
+	for (size_t r=0; valid && r<h.num_runs; r++) {
+		valid = h.run_count[r] <= (SIZE_MAX - STORE_HEADER_SIZE) / sizeof(double) - total;
+		total += h.run_count[r];
+	}
+	valid = valid && (uint64_t)store_st.st_size == STORE_HEADER_SIZE + total * sizeof(double)
+			&& check_source(source, (size_t)h.source_size, &head, &tail, &whole_lines)
+			&& head == h.head_check && tail == h.tail_check
+			&& (whole_lines || h.source_size == size);
+
+	bool ok = true;
+	if (!valid) {
+		// build it from scratch; the store replaces a cache, so none is written
+		size_t n;
+		bool cached = use_data_cache;
+		use_data_cache = false;
+		double *values = read_file_parallel(file_name, &n, threads);
+		use_data_cache = cached;
+		struct stat now;
+		if (values && (fstat(source, &now) != 0 || (size_t)now.st_size != size)) {
+			// lines were added as it was read, which the store is not to count yet
+			release_file(values);
+			values = read_new_values(file_name, 0, size, 0, &n);
+		}
+		ok = values != NULL;
+		if (ok) {
+			sort_doubles_parallel(values, n, threads);
+			memset(&h, 0, sizeof(h));
+			memcpy(h.magic, STORE_MAGIC, sizeof(h.magic));
+			h.source_size = size;
+			ok = check_source(source, size, &h.head_check, &h.tail_check, &whole_lines)
+					&& write_store(name, &h, values, n);
+			release_file(values);
+		}
+	}
+	else if (h.source_size < size) {
+		// sort the new lines, and add them as a delta or merge everything
+		size_t k;
+		double *delta = read_new_values(file_name, (size_t)h.source_size, size, (size_t)total, &k);
+		ok = delta != NULL;
+		uint64_t deltas = total - h.run_count[0] + k;
+		if (ok && (h.num_runs == STORE_MAX_RUNS || deltas * STORE_DELTA_RATIO > h.run_count[0])) {
+			SortedStore *old = map_store(name);
+			ok = old != NULL;
+			if (ok) {
+				const double *runs[STORE_MAX_RUNS + 1];
+				size_t counts[STORE_MAX_RUNS + 1];
+				memcpy(runs, old->runs, old->num_runs * sizeof(runs[0]));
+				memcpy(counts, old->run_count, old->num_runs * sizeof(counts[0]));
+				runs[old->num_runs] = delta;
+				counts[old->num_runs] = k;
+				double *merged = merge_all(runs, counts, old->num_runs + 1);
+				h.source_size = size;
+				ok = merged && check_source(source, size, &h.head_check, &h.tail_check, &whole_lines)
+						&& write_store(name, &h, merged, old->n + k);
+				free(merged);
+				sorted_store_close(old);
+			}
+		}
+		else if (ok) {
+			// the delta goes after the other runs, and only then the header that
+			// counts it, so a store cut short by a crash is rebuilt, not misread
+			h.run_count[h.num_runs++] = k;
+			h.source_size = size;
+			char header[STORE_HEADER_SIZE];
+			memset(header, 0, sizeof(header));
+			ok = check_source(source, size, &h.head_check, &h.tail_check, &whole_lines)
+					&& pwrite_all(fd, delta, k * sizeof(double), (off_t)(STORE_HEADER_SIZE + total * sizeof(double)));
+			memcpy(header, &h, sizeof(h));
+			ok = ok && pwrite_all(fd, header, sizeof(header), 0);
+			if (!ok) {
+				fprintf(stderr, "Unable to write %s\n", name);
+			}
+		}
+		free(delta);
+	}
+	if (fd >= 0)
+		close(fd);
+	close(source);
+
+	SortedStore *store = ok ? map_store(name) : NULL;
+	free(name);
+	return store;
+}
+
+/*
+ * All the values of a store, in order.
+ *
+ * Returns:
+ *		The values, to be freed (or given back with release_file), or NULL (an error
+ *		message has been printed)
+ */
+double *sorted_store_merge(const SortedStore *store)
+{
+	return merge_all(store->runs, store->run_count, store->num_runs);
+}
+
+// the first position in a run of a value not less than key, or count
+static inline size_t run_lower_bound(const double *run, size_t count, double key)
+{
+	if (count == 0) {
+		return 0;
+	}
+	const double *base = run;
+	size_t len = count;
+	while (len > 1) {
+		size_t half = len / 2;
+		base += (base[half - 1] < key) * half;
+		len -= half;
+	}
+	return (size_t)(base - run) + (*base < key);
+}
+
+/*
+ * Find where a key would go among the values of a store, by a search of each run.
+ *
+ * Returns:
+ *		The number of values less than key: its position in the merged values
+ */
+size_t sorted_store_lower_bound(const SortedStore *store, double key)
+{
+	size_t rank = 0;
+	for (size_t r=0; r<store->num_runs; r++) {
+		rank += run_lower_bound(store->runs[r], store->run_count[r], key);
+	}
+	return rank;
+}
+
+/*
+ * Look for a value in a store.
+ *
+ * Returns:
+ *		The position, in the merged values, of the first value equal to key, or -1
+ *		if there is none
+ */
+long sorted_store_find(const SortedStore *store, double key)
+{
+	size_t rank = 0;
+	bool found = false;
+	for (size_t r=0; r<store->num_runs; r++) {
+		size_t i = run_lower_bound(store->runs[r], store->run_count[r], key);
+		found |= i < store->run_count[r] && store->runs[r][i] == key;
+		rank += i;
+	}
+	return found ? (long)rank : -1;
+}
+
+/*
+ * Look for a value in a store equal to a key give or take a tolerance, as
+ * search_index_find_within does in an array.  The nearest value above the key is
+ * the least of each run's first value not less than it, and the nearest below is
+ * the greatest of each run's last value less than it.
+ *
+ * Returns:
+ *		The position, in the merged values, of the value nearest to key (the lower
+ *		one of two as near) if it is within tolerance, else -1
+ */
+long sorted_store_find_within(const SortedStore *store, double key, double tolerance)
+{
+	size_t rank = 0;
+	bool have_above = false, have_below = false;
+	double above = 0, below = 0;
+	for (size_t r=0; r<store->num_runs; r++) {
+		const double *run = store->runs[r];
+		size_t i = run_lower_bound(run, store->run_count[r], key);
+		if (i < store->run_count[r] && (!have_above || run[i] < above)) {
+			above = run[i];
+			have_above = true;
+		}
+		if (i > 0 && (!have_below || run[i - 1] > below)) {
+			below = run[i - 1];
+			have_below = true;
+		}
+		rank += i;
+	}
+
+	// the first value not less than key is at rank, and the last one less before it
+	if (have_below && (!have_above || key - below <= above - key)) {
+		return key - below <= tolerance ? (long)rank - 1 : -1;
+	}
+	if (have_above) {
+		return above - key <= tolerance ? (long)rank : -1;
+	}
+	return -1;
+}
+
+void sorted_store_close(SortedStore *store)
+{
+	if (store) {
+		munmap(store->base, store->length);
+		free(store);
+	}
+}
+
+/*
+ * Read the values of a data file in order, through its sorted store: as read_file
+ * and a sort, but only the lines added since the last time are sorted.
+ *
+ * Parameters:
+ * 		in: file_name - the name of the file to read
+ *		out: size - the number of values read
+ *		in: threads - the number of threads to use if the whole file must be sorted
+ *
+ * Returns:
+ *		The sorted values, which must be given back with release_file, or NULL (an
+ *		error message has been printed)
+ */
+double *sorted_store_read(const char *file_name, size_t *size, int threads)
+{
+	SortedStore *store = sorted_store_open(file_name, threads);
+	if (!store) {
+		return NULL;
+	}
+	double *values = sorted_store_merge(store);
+	if (values) {
+		*size = store->n;
+	}
+	sorted_store_close(store);
+	return values;
+}
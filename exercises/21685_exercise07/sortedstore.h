@@ -0,0 +1,48 @@
+#ifndef SORTEDSTORE_H
+#define SORTEDSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STORE_SUFFIX		".sorted"	// added to the data file name to name its store
+#define STORE_MAGIC			"DBLSORT1"	// first eight bytes of every store file
+#define STORE_HEADER_SIZE	128			// the runs start this far into the file
+#define STORE_MAX_RUNS		8			// the base run and up to seven delta runs
+#define STORE_DELTA_RATIO	8			// compact when the deltas are this big a part of the base
+#define STORE_CHECK_BYTES	4096		// bytes at each end of the data file checked for changes
+
+// A store covers the data file up to its size when the store was last brought up to
+// date.  Lines added after that are sorted into it, but only if the part it covers
+// ended with a newline; a data file whose last line has no newline is sorted again
+// from the start each time it grows.
+
+// The start of a store file.  The runs follow at STORE_HEADER_SIZE, one after the
+// other, each a sorted array of doubles in the byte order of the machine that wrote it.
+typedef struct store_header_struct {
+	char magic[8];					// STORE_MAGIC
+	uint64_t source_size;			// bytes of the data file the runs hold the values of
+	uint64_t head_check;			// a checksum of its first STORE_CHECK_BYTES bytes
+	uint64_t tail_check;			// and of its last STORE_CHECK_BYTES before source_size
+	uint64_t num_runs;
+	uint64_t run_count[STORE_MAX_RUNS];	// values in the base run, then in each delta
+} StoreHeader;
+
+// the sorted values of a data file, in a few sorted runs
+typedef struct sorted_store_struct {
+	void *base;						// the store file, mapped
+	size_t length;
+	const double *runs[STORE_MAX_RUNS];
+	size_t run_count[STORE_MAX_RUNS];
+	size_t num_runs;
+	size_t n;						// the number of values in all the runs
+} SortedStore;
+
+SortedStore *sorted_store_open(const char *file_name, int threads);
+double *sorted_store_merge(const SortedStore *store);
+size_t sorted_store_lower_bound(const SortedStore *store, double key);
+long sorted_store_find(const SortedStore *store, double key);
+long sorted_store_find_within(const SortedStore *store, double key, double tolerance);
+void sorted_store_close(SortedStore *store);
+double *sorted_store_read(const char *file_name, size_t *size, int threads);
+
+#endif
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <searchindex.h>
+#include <learnedindex.h>
+
+#define MIN_COUNT		(1 << 10)	// 8 KB of values, well inside L1
+#define DEFAULT_MAX_COUNT	(1 << 24)	// 128 MB of values, well beyond the last level cache
+#define QUERIES			(1 << 21)	// lookups timed at each size
+#define TOLERANCE		100			// for search_index_find_within; values are about 500 apart
+#define RANGE_WIDTH		10000		// of the ranges counted
+
+/*
+ * Return the time in milliseconds from a monotonic clock.
+ */
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static inline uint64_t next_random(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+// the textbook binary search, for comparison
+static size_t lower_bound(const double *array, size_t n, double key)
+{
+	size_t l = 0, r = n;
+	while (l < r) {
+		size_t mid = l + (r - l) / 2;
+		if (array[mid] < key) {
+			l = mid + 1;
+		}
+		else {
+			r = mid;
+		}
+	}
+	return l;
+}
+
+/*
+ * Time the other kinds of query the index answers, and check each answer against
+ * one worked out from a binary search of the sorted array.
+ *
+ * Parameters:
+ *		in: index, array, n - the index and the sorted values it was built from
+ *		in: queries - QUERIES keys to look for
+ *		out: ms - the milliseconds taken by the upper bound, nearest value, tolerant
+ *				match and range count queries
+ *
+ * Returns:
+ *		true if every answer was right
+ */
+static bool time_other_queries(const SearchIndex *index, const double *array, size_t n, const double *queries, double ms[4])
+{
+	size_t sums[4] = { 0, 0, 0, 0 };
+	double start = now_ms();
+	for (size_t i=0; i<QUERIES; i++) {
+		sums[0] += search_index_upper_bound(index, queries[i]);
+	}
+	ms[0] = now_ms() - start;
+	start = now_ms();
+	for (size_t i=0; i<QUERIES; i++) {
+		sums[1] += (size_t)search_index_nearest(index, queries[i]);
+	}
+	ms[1] = now_ms() - start;
+	start = now_ms();
+	for (size_t i=0; i<QUERIES; i++) {
+		sums[2] += (size_t)search_index_find_within(index, queries[i], TOLERANCE);
+	}
+	ms[2] = now_ms() - start;
+	start = now_ms();
+	for (size_t i=0; i<QUERIES; i++) {
+		sums[3] += search_index_count_range(index, queries[i], queries[i] + RANGE_WIDTH);
+	}
+	ms[3] = now_ms() - start;
+
+	size_t expect[4] = { 0, 0, 0, 0 };
+	for (size_t i=0; i<QUERIES; i++) {
+		double key = queries[i];
+		size_t lower = lower_bound(array, n, key);
+		size_t upper = lower;
+		while (upper < n && array[upper] == key) {
+			upper++;
+		}
+		expect[0] += upper;
+		size_t near = lower;
+		if (lower == n || (lower > 0 && key - array[lower - 1] <= array[lower] - key)) {
+			near = lower - 1;
+		}
+		expect[1] += near;
+		bool within = array[near] - key <= TOLERANCE && key - array[near] <= TOLERANCE;
+		expect[2] += within ? near : (size_t)-1;
+		size_t end = lower;
+		while (end < n && array[end] <= key + RANGE_WIDTH) {
+			end++;
+		}
+		expect[3] += end - lower;
+	}
+	return memcmp(sums, expect, sizeof(sums)) == 0;
+}
+
+/*
+ * Time lookups of random keys with a binary search of the sorted array, with a
+ * search index one at a time, with the index a batch at a time, and with a learned
+ * index, for arrays from MIN_COUNT values up to a size far beyond the caches, and
+ * check that all give the same answers, and time the index's other queries too.
+ *
+ * Parameters:
+ *		argv - optional, "-n count" the most values to search, "-t threads" the
+ *				threads to search a batch with, "-s" for skewed values (with gaps
+ *				from 1 to 2^40) rather than ones that grow about linearly
+ *
+ * Returns:
+ *		0 on success, else 1
+ */
+int main(int argc, char *argv[])
+{
+	size_t max_count = DEFAULT_MAX_COUNT;
+	int threads = 1;
+	bool skewed = false;
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atol(argv[i+1]) > 0) {
+			max_count = (size_t)atol(argv[++i]);
+		} else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc && atoi(argv[i+1]) > 0) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-s") == 0) {
+			skewed = true;
+		} else {
+			fprintf(stderr, "Usage: %s [-n count] [-t threads] [-s]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	double *array = (double *)malloc(max_count * sizeof(double));
+	double *queries = (double *)malloc(QUERIES * sizeof(double));
+	long *results = (long *)malloc(QUERIES * sizeof(long));
+	if (!array || !queries || !results) {
+		fprintf(stderr, "Unable to allocate %ld bytes for the values\n", (long) ((max_count + 2 * QUERIES) * sizeof(double)));
+		free(array);
+		free(queries);
+		free(results);
+		return 1;
+	}
+
+	uint64_t state = 88172645463325252ull;
+	printf("     values         KB  binary ns  index ns  batch ns   speedup  upper ns nearest ns within ns  range ns learned ns\n");
+	for (size_t n=MIN_COUNT; n<=max_count; n*=4) {
+		// increasing values with random gaps, and keys that hit and miss them
+		double v = 0;
+		for (size_t i=0; i<n; i++) {
+			uint64_t r = next_random(&state);
+			v += skewed ? (double)(UINT64_C(1) << r % 40) : (double)(1 + r % 1000);
+			array[i] = v;
+		}
+		for (size_t i=0; i<QUERIES; i++) {
+			queries[i] = (double)(next_random(&state) % (uint64_t)(v + 2));
+		}
+		SearchIndex *index = search_index_build(array, n);
+		LearnedIndex *model = learned_index_build(array, n);
+		if (!index || !model) {
+			search_index_free(index);
+			learned_index_free(model);
+			free(array);
+			free(queries);
+			free(results);
+			return 1;
+		}
+
+		size_t sum_binary = 0, sum_index = 0, sum_learned = 0;
+		double start = now_ms();
+		for (size_t i=0; i<QUERIES; i++) {
+			sum_binary += lower_bound(array, n, queries[i]);
+		}
+		double binary_ms = now_ms() - start;
+		start = now_ms();
+		for (size_t i=0; i<QUERIES; i++) {
+			sum_index += search_index_lower_bound(index, queries[i]);
+		}
+		double index_ms = now_ms() - start;
+		start = now_ms();
+		for (size_t i=0; i<QUERIES; i++) {
+			sum_learned += learned_index_lower_bound(model, queries[i]);
+		}
+		double learned_ms = now_ms() - start;
+		learned_index_free(model);
+		start = now_ms();
+		search_index_find_batch(index, queries, QUERIES, results, threads);
+		double batch_ms = now_ms() - start;
+		double other_ms[4];
+		bool same = sum_binary == sum_index && sum_binary == sum_learned && time_other_queries(index, array, n, queries, other_ms);
+		for (size_t i=0; i<QUERIES && same; i++) {
+			same = results[i] == search_index_find(index, queries[i]);
+		}
+		search_index_free(index);
+
+		if (!same) {
+			fprintf(stderr, "The searches disagree with %ld values\n", (long) n);
+			free(array);
+			free(queries);
+			free(results);
+			return 1;
+		}
+		printf("%11ld %10ld %10.1f %9.1f %9.1f %9.2f %9.1f %10.1f %9.1f %9.1f %10.1f\n", (long) n, (long) (n * sizeof(double) / 1024),
+				binary_ms * 1e6 / QUERIES, index_ms * 1e6 / QUERIES, batch_ms * 1e6 / QUERIES, binary_ms / batch_ms,
+				other_ms[0] * 1e6 / QUERIES, other_ms[1] * 1e6 / QUERIES, other_ms[2] * 1e6 / QUERIES, other_ms[3] * 1e6 / QUERIES,
+				learned_ms * 1e6 / QUERIES);
+	}
+
+	free(array);
+	free(queries);
+	free(results);
+	return 0;
+}
@@ -1,130 +1,149 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
-#define DATA_FILE	"data.txt"
-#define INPUT_SIZE	512		// reasonably large for a line containing one double
-
-double *read_file(const char *file_name, size_t *size);
-
-int Z2Z2zbinsearch(double *array, int l, int r, double t) {
+#include <datafile.h>
+#include <datacache.h>
+#include <searchindex.h>
+#include <learnedindex.h>
+#include <sortedstore.h>
 
-    int mid = (r+l)/2;
-    if (array[])
-
-}
+#define DATA_FILE	"data.txt"
 
 /*
  * Read a sorted list of floating point values from a file and search for specific
- * values in that list, displaying whether or not each value was found.
- * search results to stdout
+ * values in that list, displaying the position of each value found (-1 if it was
+ * not) to stdout
  *
- * Parameters: n/a
+ * Parameters:
+ *		in: argv - optional, "-q file" to read the values to search for from a file,
+ *				"-j threads" to search with several threads, "-e tolerance" to find
+ *				the nearest value within that distance of each rather than an equal
+ *				one, "-l" to search with a learned index (for equal values only),
+ *				"-s" to search the file's sorted store (see sortedstore.h), which
+ *				need not be sorted again when lines are added to the file, "-c" to
+ *				save the parsed values in a cache next to the file and use it on
+ *				later runs (see datacache.h), then the file to search instead of
+ *				DATA_FILE
  *
  * Returns:
  *		0 on success, else 1
  */
-int main(void)
+int main(int argc, char *argv[])
 {
 	size_t num;		// the number of elements in the array created by read_file
 
-	// Read in the values from the data file
-	double *array = read_file(DATA_FILE, &num);
-	if (!array) {
-		// there was a problem reading the file, error message already printed
+	int threads = 1;			// threads to search with
+	double tolerance = 0;		// how far a value found may be from the one searched for
+	bool learned = false;		// search with a learned index (for exact matches)
+	bool use_store = false;		// search the sorted store of the file
+	const char *query_name = NULL;	// where to read the values to search for, NULL for search_values
+	const char *file_name = DATA_FILE;
+	bool bad_usage = false;
+	for (int i=1; i<argc && !bad_usage; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc && atof(argv[i+1]) >= 0) {
+			tolerance = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-s") == 0) {
+			use_store = true;
+		} else if (strcmp(argv[i], "-l") == 0) {
+			learned = true;
+		} else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+			query_name = argv[++i];
+		} else if (strcmp(argv[i], "-c") == 0) {
+			use_data_cache = true;
+		} else if (i == argc - 1 && (argv[i][0] != '-' || argv[i][1] == '\0')) {
+			file_name = argv[i];
+		} else {
+			bad_usage = true;
+		}
+	}
+	// a learned index only finds equal values, and only in an array
+	if (bad_usage || (learned && (use_store || tolerance > 0))) {
+		fprintf(stderr, "Usage: %s [-j threads] [-l | [-e tolerance] [-s]] [-q queries] [-c] [file]\n", argv[0]);
 		return 1;
 	}
 
-	double search_values[] = { 89.452, 1.925, 166.096, 158.100, 200.001, 1.905, 200.005, 85.698 };
-	int search_items = sizeof(search_values) / sizeof(double);	// number of search_values
-
-	/************************ Student's code goes here *******************/
-
-    for (int i=0;i<search_items;++i) {
-        printf("%d) %f\t%d\n", i+1, search_values[i], Z2zbinsearch(array, 0, num-1, search_values[i]));
-    }
-
-	/*********************************************************************/
-
-	// free the array (memory allocated by read_file)
-	free(array);
-
-	return 0;
-}
-
-/*
- * Read a file.  The file is expected to contain a series of floating point values, one
- * to a line.  Space is allocated for the values in the form of an array of doubles.
- * Memory for the array must be freed by the caller.
- *
- * Parameters:
- * 		in: file_name - the name of the file to read
- *		in: pointer to a value in which to store the number of values read
- *
- * Returns:
- *		A pointer to an array of double values.
- *		Returns NULL and an error message is printed to stderr if an error is encountered.
- */
-double *read_file(const char *file_name, size_t *size)
-{
-	// open the file for reading
-	FILE *fp = fopen(file_name, "r");
-	if (fp == NULL) {
-		fprintf(stderr, "Unable to open %s for reading\n", file_name);
-		return NULL;
+	// Read in the values from the data file, or the store that has them sorted
+	SortedStore *store = NULL;
+	double *array = NULL;
+	if (use_store) {
+		store = sorted_store_open(file_name, threads);
+		num = store ? store->n : 0;
 	}
-
-	// Determine the number of lines in the file (and therefore the number of double
-	// values, since the file is expected to have one value per line) by counting
-	// the lines.  We need to know this so we can allocated an appropriate sized
-	// array for the values.
-	char input[INPUT_SIZE];		// space to store the line read from the file
-	int num = 0;				// number of items read
-	// fgets returns NULL at end of file or if there is an error
-	while(fgets(input, INPUT_SIZE, fp) != NULL) {
-		num ++;
+	else {
+		array = read_file(file_name, &num);
 	}
-	rewind(fp);	// move the file pointer back to the start of the file
-
-	// returning the number of values in the file
-	*size = num;
-
-	// Allocate space for the contents of the file.  The size to allocate is the number
-	// of values in the file multiply by the size, in bytes, of each item (in this case,
-	// we are storing doubles in the array)
-	double *array = (double *)malloc(num * sizeof(double));
-	if(!array) {
-		fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) num);
-		return NULL;
+	if (!array && !store) {
+		// there was a problem reading the file, error message already printed
+		return 1;
 	}
 
-	// Read the file one line at a time and parse the value from the line using sscanf.
-	int i;
-	bool have_error = false;
-	for (i=0; i<num && !have_error; i++) {
-		// Get the line and put it into a string
-		if(fgets(input, INPUT_SIZE, fp) == NULL) {
-			fprintf(stderr, "Unable to read values from %s\n", DATA_FILE);
-			have_error = true;
-		}
-		// Parse the value from the input line and store it in the array.
-		// sscanf returns the number of values in the string that match the pattern it is given,
-		// in this case "%lf" for one double value.
-		if(sscanf(input, "%lf", &array[i]) != 1) {
-			fprintf(stderr, "Line %d of %s does not contain a valid floating point number\n", i+1, DATA_FILE);
-			have_error = true;
+	double default_values[] = { 89.452, 1.925, 166.096, 158.100, 200.001, 1.905, 200.005, 85.698 };
+	double *search_values = default_values;
+	size_t search_items = sizeof(default_values) / sizeof(double);	// number of search_values
+	if (query_name) {
+		// the cache is for the data file; a query file is read once and left alone
+		use_data_cache = false;
+		search_values = read_file(query_name, &search_items);
+		if (!search_values) {
+			release_file(array);
+			sorted_store_close(store);
+			return 1;
 		}
 	}
 
-	// close the input file
-	fclose(fp);
+	/************************ Student's code goes here *******************/
 
-	// check for an error - if there was an error parsing the file, free the space and return NULL
-	if (have_error) {
-		free(array);
-		array = NULL;
-		*size = 0;
-	}
+    SearchIndex *index = learned || store ? NULL : search_index_build(array, num);
+    LearnedIndex *model = learned ? learned_index_build(array, num) : NULL;
+    long *found = (long *)malloc(search_items * sizeof(long));
+    int result = 1;
+    if (!found) {
+        fprintf(stderr, "Unable to allocate %ld bytes for the results\n", (long) (search_items * sizeof(long)));
+    }
+    else if (index || model || store) {
+        if (store && tolerance > 0) {
+            for (size_t i=0;i<search_items;++i) {
+                found[i] = sorted_store_find_within(store, search_values[i], tolerance);
+            }
+        }
+        else if (store) {
+            for (size_t i=0;i<search_items;++i) {
+                found[i] = sorted_store_find(store, search_values[i]);
+            }
+        }
+        else if (model) {
+            for (size_t i=0;i<search_items;++i) {
+                found[i] = learned_index_find(model, search_values[i]);
+            }
+        }
+        else if (tolerance > 0) {
+            for (size_t i=0;i<search_items;++i) {
+                found[i] = search_index_find_within(index, search_values[i], tolerance);
+            }
+        }
+        else {
+            search_index_find_batch(index, search_values, search_items, found, threads);
+        }
+        for (size_t i=0;i<search_items;++i) {
+            printf("%ld) %f\t%ld\n", (long) i+1, search_values[i], found[i]);
+        }
+        result = 0;
+    }
+    free(found);
+    search_index_free(index);
+    learned_index_free(model);
+
+	/*********************************************************************/
+
+	// give back the array (allocated or mapped by read_file)
+	release_file(array);
+	sorted_store_close(store);
+	if (search_values != default_values)
+		release_file(search_values);
 
-    return array;
+	return result;
 }
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include <learnedindex.h>
+
+/*
+ * A two level recursive model index.  When the values grow about linearly, the
+ * position of a key is nearly (key - first) / (last - first) * n, and a search only
+ * has to look near there.  The root model is that straight line, scaled to pick one
+ * of num_segments segments; each segment has its own line through its first and last
+ * values, and remembers how far the positions of its values are from the line.  A
+ * lookup then reads one segment and binary searches the few positions between its
+ * error bounds, which are usually in one or two cache lines.
+ *
+ * The root only routes a key to a segment, and it does so in key order, so the
+ * answer for any key routed to a segment is between the segment's start and end,
+ * and the segment's error bounds hold for it once the key is clamped between the
+ * segment's low and high values.  If the values are so skewed that the bounds are
+ * wide on average, the index falls back to a binary search of the whole array.
+ */
+
+// where the root model sends key
+static inline size_t segment_of(const LearnedIndex *li, double key)
+{
+	double s = (key - li->first) * li->scale;
+	if (!(s >= 0)) {
+		return 0;
+	}
+	if (s >= (double)(li->num_segments - 1)) {
+		return li->num_segments - 1;
+	}
+	return (size_t)s;
+}
+
+static inline double predict(const LearnedSegment *seg, double key)
+{
+	return seg->slope * key + seg->intercept;
+}
+
+// the first position in [lo, hi) of a value not less than key, or hi
+static inline size_t bounded_lower_bound(const double *array, size_t lo, size_t hi, double key)
+{
+	const double *base = array + lo;
+	size_t len = hi - lo;
+	if (len == 0) {
+		return lo;
+	}
+	while (len > 1) {
+		size_t half = len / 2;
+		base += (base[half - 1] < key) * half;
+		len -= half;
+	}
+	return (size_t)(base - array) + (*base < key);
+}
+
+/*
+ * Fit the model for a segment, and find the error bounds of its values.
+ */
+static void fit_segment(LearnedSegment *seg, const double *array, size_t start, size_t end)
+{
+	seg->start = start;
+	seg->end = end;
+	seg->min_error = 0;
+	seg->max_error = 0;
+	if (start == end) {
+		seg->slope = 0;
+		seg->intercept = (double)start;
+		seg->low = seg->high = 0;
+		return;
+	}
+	seg->low = array[start];
+	seg->high = array[end - 1];
+	double range = seg->high - seg->low;
+	seg->slope = range > 0 ? (double)(end - 1 - start) / range : 0;
+	seg->intercept = (double)start - seg->slope * seg->low;
+	for (size_t i=start; i<end; i++) {
+		// truncated, as lookups truncate their predictions, with a position to spare
+		// either way for rounding
+		long error = (long)i - (long)predict(seg, array[i]);
+		long below = error - 1;
+		long above = error + 1;
+		if (i == start || below < seg->min_error) {
+			seg->min_error = below;
+		}
+		if (i == start || above > seg->max_error) {
+			seg->max_error = above;
+		}
+	}
+}
+
+/*
+ * Build a learned index over a sorted array.  The index keeps a pointer to the
+ * array rather than a copy.
+ *
+ * Parameters:
+ *		in: sorted - the values, in increasing order
+ *		in: n - the number of values
+ *
+ * Returns:
+ *		The index, to be freed with learned_index_free, or NULL (an error message has
+ *		been printed)
+ */
+LearnedIndex *learned_index_build(const double *sorted, size_t n)
+{
+	size_t num_segments = n / LEARNED_KEYS_PER_SEGMENT + 1;
+	LearnedIndex *li = (LearnedIndex *)calloc(1, sizeof(LearnedIndex));
+	LearnedSegment *segments = (LearnedSegment *)malloc(num_segments * sizeof(LearnedSegment));
+	if (!li || !segments) {
+		fprintf(stderr, "Unable to allocate memory to index %ld values\n", (long) n);
+		free(li);
+		free(segments);
+		return NULL;
+	}
+	li->array = sorted;
+	li->n = n;
+	li->num_segments = num_segments;
+	li->segments = segments;
+
+	double range = n > 0 ? sorted[n - 1] - sorted[0] : 0;
+	if (!(range > 0) || !isfinite(range)) {
+		// all the values the same, or too far apart to scale
+		li->skewed = n > 0;
+		fit_segment(&segments[0], sorted, 0, n);
+		for (size_t s=1; s<num_segments; s++) {
+			fit_segment(&segments[s], sorted, n, n);
+		}
+		return li;
+	}
+	li->first = sorted[0];
+	li->scale = (double)num_segments / range;
+
+	size_t start = 0;
+	double window = 0;			// the search window of each value, added up
+	for (size_t s=0; s<num_segments; s++) {
+		size_t end = start;
+		while (end < n && segment_of(li, sorted[end]) == s) {
+			end++;
+		}
+		fit_segment(&segments[s], sorted, start, end);
+		window += (double)(end - start) * (double)(segments[s].max_error - segments[s].min_error + 1);
+		start = end;
+	}
+	li->skewed = window / (double)n > LEARNED_MAX_WINDOW;
+	return li;
+}
+
+/*
+ * Find where a key would go in the sorted array.
+ *
+ * Returns:
+ *		The position of the first value not less than key, or n if there is none
+ */
+size_t learned_index_lower_bound(const LearnedIndex *li, double key)
+{
+	if (li->skewed) {
+		return bounded_lower_bound(li->array, 0, li->n, key);
+	}
+	const LearnedSegment *seg = &li->segments[segment_of(li, key)];
+	if (seg->start == seg->end) {
+		return seg->start;
+	}
+	double clamped = key < seg->low ? seg->low : key > seg->high ? seg->high : key;
+	long p = (long)predict(seg, clamped);
+	long lo = p + seg->min_error;
+	long hi = p + seg->max_error + 1;
+	size_t start = lo < (long)seg->start ? seg->start : lo > (long)seg->end ? seg->end : (size_t)lo;
+	size_t end = hi > (long)seg->end ? seg->end : hi < (long)start ? start : (size_t)hi;
+	size_t i = bounded_lower_bound(li->array, start, end, key);
+
+	// the bounds are right by construction, but a search that ends at one of them is
+	// cheap to check
+	if ((i == start && i > seg->start && li->array[i - 1] >= key)
+			|| (i == end && i < seg->end && li->array[i] < key)) {
+		i = bounded_lower_bound(li->array, seg->start, seg->end, key);
+	}
+	return i;
+}
+
+/*
+ * Look for a value in the sorted array.
+ *
+ * Returns:
+ *		The position of the first value equal to key, or -1 if there is none
+ */
+long learned_index_find(const LearnedIndex *li, double key)
+{
+	size_t i = learned_index_lower_bound(li, key);
+	return i < li->n && li->array[i] == key ? (long)i : -1;
+}
+
+void learned_index_free(LearnedIndex *li)
+{
+	if (li) {
+		free(li->segments);
+		free(li);
+	}
+}
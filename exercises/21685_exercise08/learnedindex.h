@@ -0,0 +1,38 @@
+#ifndef LEARNEDINDEX_H
+#define LEARNEDINDEX_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define LEARNED_KEYS_PER_SEGMENT	64		// values per linear piece, on average
+#define LEARNED_MAX_WINDOW		256		// a wider average search window means the data are too skewed
+
+// one piece of the model: the positions of the values from low to high
+typedef struct learned_segment_struct {
+	double slope;				// position is about slope * key + intercept
+	double intercept;
+	double low;					// the first and last values in the segment
+	double high;
+	size_t start;				// the positions of the values in the segment
+	size_t end;
+	long min_error;				// how far below and above the prediction they are
+	long max_error;
+} LearnedSegment;
+
+// a sorted array and a piecewise linear model of where each value is in it
+typedef struct learned_index_struct {
+	const double *array;		// not a copy; it must outlive the index
+	size_t n;
+	double first;				// the root model: segment (key - first) * scale
+	double scale;
+	size_t num_segments;
+	LearnedSegment *segments;
+	bool skewed;				// the model is no help, so binary search instead
+} LearnedIndex;
+
+LearnedIndex *learned_index_build(const double *sorted, size_t n);
+size_t learned_index_lower_bound(const LearnedIndex *li, double key);
+long learned_index_find(const LearnedIndex *li, double key);
+void learned_index_free(LearnedIndex *li);
+
+#endif
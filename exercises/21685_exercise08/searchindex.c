@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <searchindex.h>
+
+/*
+ * A binary search over a sorted array touches a new cache line at almost every
+ * step, and the line it needs next depends on the comparison it is making, so the
+ * processor cannot fetch it early.  In Eytzinger order the root of the search tree
+ * is at keys[1] and the children of keys[k] are at keys[2k] and keys[2k+1], so the
+ * first levels of the tree share a few cache lines and the search walks down it with
+ * k = 2k + (keys[k] < key), which compiles to a conditional move.  The eight
+ * descendants of keys[k] INDEX_PREFETCH_LEVELS levels down are next to each other at
+ * keys[8k], one aligned cache line, and are prefetched while the levels above them
+ * are searched.
+ */
+
+// put sorted[i...] at keys[k] and below in order; returns the next i
+static size_t fill(SearchIndex *idx, const double *sorted, size_t i, size_t k)
+{
+	if (k <= idx->n) {
+		i = fill(idx, sorted, i, 2 * k);
+		idx->keys[k] = sorted[i];
+		idx->rank[k] = i;
+		i = fill(idx, sorted, i + 1, 2 * k + 1);
+	}
+	return i;
+}
+
+/*
+ * Build a search index from a sorted array, which the index does not keep.
+ *
+ * Parameters:
+ *		in: sorted - the values, in increasing order
+ *		in: n - the number of values
+ *
+ * Returns:
+ *		The index, to be freed with search_index_free, or NULL (an error message has
+ *		been printed)
+ */
+SearchIndex *search_index_build(const double *sorted, size_t n)
+{
+	SearchIndex *idx = (SearchIndex *)calloc(1, sizeof(SearchIndex));
+	// keys[0] is not in the tree, so that keys[8k] starts a cache line; it holds a NaN,
+	// the key of slot 0, which stands for no value
+	size_t key_bytes = (n + 1) * sizeof(double);
+	key_bytes = (key_bytes + 63) & ~(size_t)63;
+	double *keys = (double *)aligned_alloc(64, key_bytes);
+	size_t *rank = (size_t *)malloc((n + 1) * sizeof(size_t));
+	if (!idx || !keys || !rank) {
+		fprintf(stderr, "Unable to allocate memory to index %ld values\n", (long) n);
+		free(idx);
+		free(keys);
+		free(rank);
+		return NULL;
+	}
+	idx->keys = keys;
+	idx->rank = rank;
+	idx->n = n;
+	keys[0] = NAN;
+	rank[0] = 0;
+	fill(idx, sorted, 0, 1);
+	return idx;
+}
+
+/*
+ * Walk down the tree to a leaf, going right past keys less than key (or, for upper,
+ * not greater than key).  The bits of the slot reached are the path taken: a 1 for
+ * each step right.
+ */
+static inline size_t descend(const SearchIndex *idx, double key, bool upper)
+{
+	const double *keys = idx->keys;
+	size_t n = idx->n;
+	size_t k = 1;
+	while (k <= n) {
+		__builtin_prefetch(keys + (k << INDEX_PREFETCH_LEVELS));
+		k = 2 * k + (upper ? keys[k] <= key : keys[k] < key);
+	}
+	return k;
+}
+
+// the last step left was at the first key the search did not go past, so drop the
+// steps right after it, and it; 0 if there is no such key
+static inline size_t first_not_past(size_t k)
+{
+	return k >> __builtin_ffsll((long long)~k);
+}
+
+// likewise the last step right was at the last key the search went past
+static inline size_t last_past(size_t k)
+{
+	return k >> __builtin_ffsll((long long)k);
+}
+
+// the slot in keys of the first value not less than key, or 0 if there is none
+static inline size_t find_slot(const SearchIndex *idx, double key)
+{
+	return first_not_past(descend(idx, key, false));
+}
+
+/*
+ * Find where a key would go in the sorted array.
+ *
+ * Parameters:
+ *		in: idx - the index
+ *		in: key - the value to look for
+ *
+ * Returns:
+ *		The position of the first value not less than key, or n if there is none
+ */
+size_t search_index_lower_bound(const SearchIndex *idx, double key)
+{
+	size_t k = find_slot(idx, key);
+	return k ? idx->rank[k] : idx->n;
+}
+
+/*
+ * Look for a value in the sorted array.
+ *
+ * Returns:
+ *		The position of the first value equal to key, or -1 if there is none
+ */
+long search_index_find(const SearchIndex *idx, double key)
+{
+	size_t k = find_slot(idx, key);
+	return k && idx->keys[k] == key ? (long)idx->rank[k] : -1;
+}
+
+/*
+ * Find where a key would go in the sorted array after any values equal to it.
+ *
+ * Returns:
+ *		The position of the first value greater than key, or n if there is none
+ */
+size_t search_index_upper_bound(const SearchIndex *idx, double key)
+{
+	size_t k = first_not_past(descend(idx, key, true));
+	return k ? idx->rank[k] : idx->n;
+}
+
+/*
+ * Count the values in a range.
+ *
+ * Parameters:
+ *		in: idx - the index
+ *		in: low, high - the range, including both ends
+ *
+ * Returns:
+ *		The number of values v with low <= v <= high
+ */
+size_t search_index_count_range(const SearchIndex *idx, double low, double high)
+{
+	if (!(low <= high)) {
+		return 0;
+	}
+	return search_index_upper_bound(idx, high) - search_index_lower_bound(idx, low);
+}
+
+/*
+ * The slot of the value nearest to key, or 0 if there are no values.  One walk down
+ * the tree gives both the first value not less than key and the last value less.
+ * Whether the key is nearer one or the other is random, so with branchless set the
+ * choice is made without a branch; keys[0] is a NaN, so a missing value above is
+ * never nearer and one missing below is never taken.  That is only faster when what
+ * is done next depends on the answer, as in search_index_find_within.
+ */
+static inline size_t nearest_slot(const SearchIndex *idx, double key, bool branchless)
+{
+	size_t k = descend(idx, key, false);
+	size_t above = first_not_past(k);
+	size_t below = last_past(k);
+	if (branchless) {
+		bool take_below = below && !(idx->keys[above] - key < key - idx->keys[below]);
+		size_t mask = -(size_t)take_below;
+		return (below & mask) | (above & ~mask);
+	}
+	if (!above || (below && key - idx->keys[below] <= idx->keys[above] - key)) {
+		return below;
+	}
+	return above;
+}
+
+/*
+ * Find the value closest to a key.
+ *
+ * Returns:
+ *		The position of the nearest value (the lower one of two as near), or -1 if
+ *		the array is empty
+ */
+long search_index_nearest(const SearchIndex *idx, double key)
+{
+	size_t k = nearest_slot(idx, key, false);
+	return k ? (long)idx->rank[k] : -1;
+}
+
+/*
+ * Look for a value equal to a key give or take a tolerance, for values that may
+ * have been rounded differently on their way to or from text.
+ *
+ * Parameters:
+ *		in: idx - the index
+ *		in: key - the value to look for
+ *		in: tolerance - how far from key a value may be and still match
+ *
+ * Returns:
+ *		The position of the value nearest to key if it is within tolerance, else -1
+ */
+long search_index_find_within(const SearchIndex *idx, double key, double tolerance)
+{
+	size_t k = nearest_slot(idx, key, true);
+	// an empty array gives keys[0], a NaN, which matches nothing
+	double distance = idx->keys[k] - key;
+	bool within = (distance <= tolerance) & (-distance <= tolerance);
+	long mask = -(long)within;
+	return ((long)idx->rank[k] & mask) | ~mask;
+}
+
+// levels of the tree that every search passes through
+static int full_levels(size_t n)
+{
+	int levels = 0;
+	while (((size_t)2 << levels) - 1 <= n) {
+		levels++;
+	}
+	return levels;
+}
+
+/*
+ * Look for up to INDEX_BATCH_GROUP keys at once.  Each step takes every search down
+ * one level, so the processor has the cache misses of all of them in flight together
+ * instead of waiting for each in turn.
+ */
+static void find_group(const SearchIndex *idx, const double *queries, size_t count, long *results, int levels)
+{
+	const double *keys = idx->keys;
+	size_t k[INDEX_BATCH_GROUP];
+	for (size_t j=0; j<count; j++) {
+		k[j] = 1;
+	}
+	for (int level=0; level<levels; level++) {
+		for (size_t j=0; j<count; j++) {
+			__builtin_prefetch(keys + (k[j] << INDEX_PREFETCH_LEVELS));
+			k[j] = 2 * k[j] + (keys[k[j]] < queries[j]);
+		}
+	}
+	for (size_t j=0; j<count; j++) {
+		// the last, partly filled, level
+		size_t slot = k[j];
+		if (slot <= idx->n) {
+			slot = 2 * slot + (keys[slot] < queries[j]);
+		}
+		slot >>= __builtin_ffsll((long long)~slot);
+		results[j] = slot && keys[slot] == queries[j] ? (long)idx->rank[slot] : -1;
+	}
+}
+
+// a thread's share of a batch of queries
+typedef struct batch_job_struct {
+	const SearchIndex *idx;
+	const double *queries;
+	size_t m;
+	long *results;
+} BatchJob;
+
+static void *find_block(void *arg)
+{
+	BatchJob *job = (BatchJob *)arg;
+	int levels = full_levels(job->idx->n);
+	for (size_t i=0; i<job->m; i+=INDEX_BATCH_GROUP) {
+		size_t count = job->m - i < INDEX_BATCH_GROUP ? job->m - i : INDEX_BATCH_GROUP;
+		find_group(job->idx, job->queries + i, count, job->results + i, levels);
+	}
+	return NULL;
+}
+
+/*
+ * Look for many values at once, as search_index_find does for one.  The searches are
+ * interleaved INDEX_BATCH_GROUP at a time, and the queries are shared out in blocks
+ * between the threads, so a large batch is limited by memory bandwidth rather than
+ * by the latency of one search's cache misses after another.
+ *
+ * Parameters:
+ *		in: idx - the index
+ *		in: queries - the values to look for, in any order
+ *		in: m - the number of queries
+ *		out: results - m positions in the sorted array (-1 for values not found), in
+ *				the order of the queries
+ *		in: threads - the number of threads to use
+ */
+void search_index_find_batch(const SearchIndex *idx, const double *queries, size_t m, long *results, int threads)
+{
+	if ((size_t)threads > m / INDEX_BATCH_PER_THREAD) {
+		threads = (int)(m / INDEX_BATCH_PER_THREAD);
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+	pthread_t *ids = (pthread_t *)malloc((size_t)threads * sizeof(pthread_t));
+	BatchJob *jobs = (BatchJob *)malloc((size_t)threads * sizeof(BatchJob));
+	bool *started = (bool *)calloc((size_t)threads, sizeof(bool));
+	if (!ids || !jobs || !started) {
+		// search on this thread alone
+		BatchJob job = { idx, queries, m, results };
+		find_block(&job);
+		free(ids);
+		free(jobs);
+		free(started);
+		return;
+	}
+	for (int t=0; t<threads; t++) {
+		size_t start = m / (size_t)threads * (size_t)t;
+		size_t end = t == threads - 1 ? m : m / (size_t)threads * (size_t)(t + 1);
+		jobs[t].idx = idx;
+		jobs[t].queries = queries + start;
+		jobs[t].m = end - start;
+		jobs[t].results = results + start;
+		started[t] = t > 0 && pthread_create(&ids[t], NULL, find_block, &jobs[t]) == 0;
+	}
+	find_block(&jobs[0]);
+	for (int t=1; t<threads; t++) {
+		if (started[t]) {
+			pthread_join(ids[t], NULL);
+		}
+		else {
+			find_block(&jobs[t]);
+		}
+	}
+	free(ids);
+	free(jobs);
+	free(started);
+}
+
+void search_index_free(SearchIndex *idx)
+{
+	if (idx) {
+		free(idx->keys);
+		free(idx->rank);
+		free(idx);
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <stddef.h>
+
+#define INDEX_PREFETCH_LEVELS	3	// prefetch this far down: 2^3 doubles fill a 64 byte line
+#define INDEX_BATCH_GROUP		16	// searches of a batch that step down the tree together
+#define INDEX_BATCH_PER_THREAD	(1 << 14)	// fewer queries than this per thread use fewer threads
+
+// a sorted array laid out in Eytzinger (breadth first) order for searching
+typedef struct search_index_struct {
+	double *keys;				// keys[1..n]: the root, its children, theirs, ...
+	size_t *rank;				// rank[k]: the position of keys[k] in the sorted array
+	size_t n;
+} SearchIndex;
+
+SearchIndex *search_index_build(const double *sorted, size_t n);
+size_t search_index_lower_bound(const SearchIndex *idx, double key);
+long search_index_find(const SearchIndex *idx, double key);
+size_t search_index_upper_bound(const SearchIndex *idx, double key);
+size_t search_index_count_range(const SearchIndex *idx, double low, double high);
+long search_index_nearest(const SearchIndex *idx, double key);
+long search_index_find_within(const SearchIndex *idx, double key, double tolerance);
+void search_index_find_batch(const SearchIndex *idx, const double *queries, size_t m, long *results, int threads);
+void search_index_free(SearchIndex *idx);
+
+#endif
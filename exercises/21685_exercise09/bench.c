@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <countsort.h>
+
+#define DEFAULT_COUNT	100000000	// number of random items to sort
+#define RUNS			3			// runs of each sort; the fastest is reported
+
+/*********
+ * now_ms - returns the time in milliseconds from a monotonic clock
+ **********/
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool is_sorted(const short int data[], size_t size, int direction)
+{
+	for (size_t i=1; i<size; i++) {
+		if (direction == ASCENDING ? data[i] < data[i-1] : data[i] > data[i-1]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*********
+ * time_sort - times counting_sort on a copy of the items, and checks the result
+ *
+ * return value: the fastest time in milliseconds, or a negative number if the
+ * 				 items were not sorted
+ **********/
+static double time_sort(const short int items[], short int data[], size_t size, int direction, int threads)
+{
+	double best = 0;
+	for (int run=0; run<RUNS; run++) {
+		memcpy(data, items, size * sizeof(short int));
+		double start = now_ms();
+		counting_sort(data, size, direction, threads);
+		double ms = now_ms() - start;
+		if (run == 0 || ms < best) {
+			best = ms;
+		}
+		if (!is_sorted(data, size, direction)) {
+			return -1;
+		}
+	}
+	return best;
+}
+
+/*********
+ * main - times counting_sort on random items, and on items in runs of equal values
+ * 		  (where the sub-histograms matter most), in both directions, with 1, 2, ...
+ * 		  threads
+ *
+ * input:
+ * 		argv - optional, "-n count" items to sort, "-t threads" the most threads to
+ * 			   use (the number of processors by default)
+ *
+ * return value: 1 if there was an error, else 0
+ **********/
+int main(int argc, char *argv[])
+{
+	size_t size = DEFAULT_COUNT;
+	int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atol(argv[i+1]) > 0) {
+			size = (size_t)atol(argv[++i]);
+		} else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc && atoi(argv[i+1]) > 0) {
+			max_threads = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "Usage: %s [-n count] [-t threads]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (max_threads < 1) {
+		max_threads = 1;
+	}
+
+	short int *items = (short int *)malloc(size * sizeof(short int));
+	short int *data = (short int *)malloc(size * sizeof(short int));
+	if (!items || !data) {
+		fprintf(stderr, "Unable to allocate %ld bytes for the items\n", (long) (2 * size * sizeof(short int)));
+		free(items);
+		free(data);
+		return 1;
+	}
+
+	printf("sorting %ld items\n", (long) size);
+	printf("data        direction   threads         ms  Gkeys/s\n");
+	uint64_t state = 88172645463325252ull;
+	for (int runs=0; runs<2; runs++) {
+		for (size_t i=0; i<size; i++) {
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			// runs of equal values go up slowly, with a value now and then out of place
+			items[i] = runs ? (short int)((i >> 12) + (state % 64 == 0 ? (int)(state >> 48) : 0)) : (short int)state;
+		}
+		for (int direction=ASCENDING; direction<=DESCENDING; direction++) {
+			for (int t=1; t<=max_threads; t++) {
+				double ms = time_sort(items, data, size, direction, t);
+				if (ms < 0) {
+					fprintf(stderr, "The items are not sorted with %d threads\n", t);
+					free(items);
+					free(data);
+					return 1;
+				}
+				printf("%-11s %-11s %7d %10.1f %8.2f\n", runs ? "runs" : "random",
+						direction == ASCENDING ? "ascending" : "descending", t, ms, size / ms / 1e6);
+			}
+		}
+	}
+
+	free(items);
+	free(data);
+	return 0;
+}
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <countsort.h>
+
+/*
+ * A short int has only COUNT_KEYS possible values, so instead of comparing items the
+ * sort counts how many there are of each value (a histogram) and then writes each
+ * value out that many times, in O(n + COUNT_KEYS).
+ *
+ * Counting is one load and one store per item, so its speed is set by how soon an
+ * increment can follow another to the same count: in sorted or repetitive data the
+ * next item usually has the same value, and its increment must wait for the last
+ * one's store to reach the count again.  Consecutive items are therefore counted in
+ * COUNT_SUB_HISTOGRAMS separate histograms (of 32-bit counts, added into the totals
+ * before they can overflow), which are summed at the end.  Writing the values out
+ * is a fill of each run, which the compiler vectorizes.
+ *
+ * With several threads each counts its own block of the data, the histograms are
+ * added up, and then each thread writes its own part of the output.
+ */
+
+// the histogram bin of a value: the bins of negative values come first
+static inline unsigned bin_of(short int value)
+{
+	return (uint16_t)value ^ 0x8000u;
+}
+
+static inline short int value_of(unsigned bin)
+{
+	return (short int)(uint16_t)(bin ^ 0x8000u);
+}
+
+/*********
+ * count_values - adds the number of items with each value to a histogram
+ *
+ * input:
+ * 		data - the items
+ * 		size - the number of items
+ * 		sub - COUNT_SUB_HISTOGRAMS * COUNT_KEYS counts, all zero, to work in
+ *
+ * output:
+ * 		counts - COUNT_KEYS totals, added to; sub is left zero
+ *
+ * return value: none
+ **********/
+static void count_values(const short int data[], size_t size, size_t counts[], uint32_t sub[])
+{
+	// each sub-histogram counts only part of a block, so it cannot overflow
+	const size_t block = (size_t)UINT32_MAX;
+	for (size_t start=0; start<size; start+=block) {
+		size_t end = size - start < block ? size : start + block;
+		size_t i = start;
+		for (; i + COUNT_SUB_HISTOGRAMS <= end; i += COUNT_SUB_HISTOGRAMS) {
+			for (int s=0; s<COUNT_SUB_HISTOGRAMS; s++) {
+				sub[s * COUNT_KEYS + bin_of(data[i + s])]++;
+			}
+		}
+		for (; i < end; i++) {
+			sub[bin_of(data[i])]++;
+		}
+		for (int s=0; s<COUNT_SUB_HISTOGRAMS; s++) {
+			uint32_t *h = sub + s * COUNT_KEYS;
+			for (unsigned b=0; b<COUNT_KEYS; b++) {
+				counts[b] += h[b];
+			}
+			memset(h, 0, COUNT_KEYS * sizeof(uint32_t));
+		}
+	}
+}
+
+/*********
+ * write_values - writes part of the sorted output from the histogram
+ *
+ * input:
+ * 		counts - the number of items with each value
+ * 		direction - ASCENDING or DESCENDING
+ * 		start, end - the positions in the output to write
+ *
+ * output:
+ * 		data - data[start] to data[end-1] are written
+ *
+ * return value: none
+ **********/
+static void write_values(short int data[], const size_t counts[], int direction, size_t start, size_t end)
+{
+	size_t pos = 0;
+	for (unsigned k=0; k<COUNT_KEYS && pos < end; k++) {
+		unsigned b = direction == ASCENDING ? k : COUNT_KEYS - 1 - k;
+		size_t from = pos > start ? pos : start;
+		pos += counts[b];
+		size_t to = pos < end ? pos : end;
+		short int value = value_of(b);
+		for (size_t i=from; i<to; i++) {
+			data[i] = value;
+		}
+	}
+}
+
+// a thread's part of a counting sort
+typedef struct count_job_struct {
+	short int *data;
+	size_t start;				// this thread's items, and its part of the output
+	size_t end;
+	size_t *counts;				// this thread's histogram, then the totals
+	int direction;
+	bool no_memory;
+} CountJob;
+
+static void *count_block(void *arg)
+{
+	CountJob *job = (CountJob *)arg;
+	uint32_t *sub = (uint32_t *)calloc(COUNT_SUB_HISTOGRAMS * COUNT_KEYS, sizeof(uint32_t));
+	if (!sub) {
+		job->no_memory = true;
+		return NULL;
+	}
+	count_values(job->data + job->start, job->end - job->start, job->counts, sub);
+	free(sub);
+	return NULL;
+}
+
+static void *write_block(void *arg)
+{
+	CountJob *job = (CountJob *)arg;
+	write_values(job->data, job->counts, job->direction, job->start, job->end);
+	return NULL;
+}
+
+/*********
+ * run_jobs - runs fn once for each job, all but the first on new threads; a job
+ * 			  whose thread cannot be started (or that there is no memory to keep
+ * 			  track of) is run on this one
+ **********/
+static void run_jobs(CountJob jobs[], int threads, void *(*fn)(void *))
+{
+	pthread_t *ids = (pthread_t *)malloc((size_t)threads * sizeof(pthread_t));
+	bool *started = (bool *)calloc((size_t)threads, sizeof(bool));
+	for (int t=1; t<threads && ids && started; t++) {
+		started[t] = pthread_create(&ids[t], NULL, fn, &jobs[t]) == 0;
+	}
+	fn(&jobs[0]);
+	for (int t=1; t<threads; t++) {
+		if (started && started[t]) {
+			pthread_join(ids[t], NULL);
+		}
+		else {
+			fn(&jobs[t]);
+		}
+	}
+	free(ids);
+	free(started);
+}
+
+/*********
+ * counting_sort - sorts an array of short ints by counting the items with each
+ * 				   value.  The array is sorted in place (the caller's array is
+ * 				   changed).
+ *
+ * input:
+ * 		data - an array of short integer numbers to sort
+ * 		size - the number of items in data
+ * 		direction - ASCENDING or DESCENDING
+ * 		threads - the number of threads to use
+ *
+ * output:
+ * 		data is modified (sorted); if there is not enough memory to sort it, an
+ * 		error message is printed and data is unchanged
+ *
+ * return value: none
+ **********/
+void counting_sort(short int data[], size_t size, int direction, int threads)
+{
+	if ((size_t)threads > size / COUNT_MIN_PER_THREAD) {
+		threads = (int)(size / COUNT_MIN_PER_THREAD);
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	size_t *counts = (size_t *)calloc((size_t)threads * COUNT_KEYS, sizeof(size_t));
+	CountJob *jobs = (CountJob *)calloc((size_t)threads, sizeof(CountJob));
+	if (!counts || !jobs) {
+		fprintf(stderr, "Unable to allocate memory to sort %ld items\n", (long) size);
+		free(counts);
+		free(jobs);
+		return;
+	}
+	for (int t=0; t<threads; t++) {
+		jobs[t].data = data;
+		jobs[t].start = size / (size_t)threads * (size_t)t;
+		jobs[t].end = t == threads - 1 ? size : size / (size_t)threads * (size_t)(t + 1);
+		jobs[t].counts = counts + (size_t)t * COUNT_KEYS;
+		jobs[t].direction = direction;
+	}
+	run_jobs(jobs, threads, count_block);
+
+	bool no_memory = false;
+	for (int t=0; t<threads; t++) {
+		no_memory |= jobs[t].no_memory;
+	}
+	if (no_memory) {
+		fprintf(stderr, "Unable to allocate memory to sort %ld items\n", (long) size);
+	}
+	else {
+		// add up the histograms; every thread writes its part from the totals
+		for (int t=1; t<threads; t++) {
+			const size_t *h = counts + (size_t)t * COUNT_KEYS;
+			for (unsigned b=0; b<COUNT_KEYS; b++) {
+				counts[b] += h[b];
+			}
+		}
+		for (int t=0; t<threads; t++) {
+			jobs[t].counts = counts;
+		}
+		run_jobs(jobs, threads, write_block);
+	}
+
+	free(counts);
+	free(jobs);
+}
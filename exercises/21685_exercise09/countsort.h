@@ -0,0 +1,15 @@
+#ifndef COUNTSORT_H
+#define COUNTSORT_H
+
+#include <stddef.h>
+
+#define ASCENDING	1				// sort in ascending order
+#define DESCENDING	2			// sort in descending order
+
+#define COUNT_KEYS				65536		// every short int value has a count
+#define COUNT_SUB_HISTOGRAMS	2			// counts kept apart so neighbouring equal keys do not wait on each other
+#define COUNT_MIN_PER_THREAD	(1 << 18)	// fewer items than this per thread use fewer threads
+
+void counting_sort(short int data[], size_t size, int direction, int threads);
+
+#endif
@@ -7,87 +7,14 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <unistd.h>
+
+#include <countsort.h>
+#include <itemfile.h>
 
 #define DEBUG		0
 
 #define DATA_FILE	"data.txt"	// Name of a data file containing the data to search (short ints)
-#define INPUT_SIZE	7			// big enough for a short int with an optional sign
-
-#define ASCENDING	1				// sort in ascending order
-#define DESCENDING	2			// sort in descending order
-
-/*********
- * bubble_sort - sorts an array into ascending order using the (inefficient)
- * 				 bubble sort algorithm.  The array is sorted in place (the
- * 				 caller's array is changed).
- *
- * input:
- * 		array - an array of short integer numbers to sort
- * 		array_size - the number of items in array
- *
- * output:
- * 		array is modified (sorted)
- *
- * return value: none
- **********/
-void bubble_sort(short int data[], const short int size, int direction) {
-	short int tmp;		// temporary value storage
-	int i, j;
-	bool swap;
-
-#if DEBUG > 0
-	printf("Debug: entering bubble_sort, sort direction %s, size %d\n", direction == ASCENDING ? "ascending" : "descending", size);
-#endif
-#if DEBUG > 1
-	printf("Debug: sorting...");
-	for (i=0; i<size; i++) {
-		printf("  %d", data[i]);
-	}
-	printf("\n");
-#endif
-
-	// Starting from the beginning of the array, go through every item in the array...
-	for (i=0; i<size; i++) {
-
-		// the item at i is the current item, now search the entire array, starting
-		// at the beginning, looking for the first value that is greater than or less
-		// than (depending on direction) the current item.  Once found, swap them.
-		for (j=0; j<size; j++) {
-#if DEBUG > 2
-			printf("Debug: comparing %d and %d\n", data[j], data[i]);
-#endif
-			if (direction == ASCENDING) {
-				if (data[j] < data[i])
-					swap = true;
-				else
-					swap = false;
-			} else {		// direction is DESCENDING
-				if (data[j] > data[i])
-					swap = true;
-				else
-					swap = false;
-			}
-			if (swap) {
-				tmp = data[i];
-				data[i] = data[j];
-				data[j] = tmp;
-			}
-		}
-	}
-
-#if DEBUG > 1
-	printf("Debug: sorted...");
-	for (i=0; i<size; i++) {
-		printf("  %d", data[i]);
-	}
-	printf("\n");
-#endif
-#if DEBUG > 0
-	printf("Debug: leaving bubble_sort\n");
-#endif
-
-	return;
-}
 
 /*********
  * binary_search - Uses a binary search algorithm to search for an item in
@@ -96,17 +23,17 @@ void bubble_sort(short int data[], const short int size, int direction) {
  *
  * input:
  * 		search_value - the value to search for
- * 		array - an array of int
+ * 		array - an array of short int
  * 		array_size - the number of items in array
  *
  * output: none
  *
  * return value: true if the item was found, else false
  **********/
-bool binary_search(const short int search_value, const short int array[], const short int array_size) {
-	int low = 0;
-	int high = array_size - 1;
-	int mid;
+bool binary_search(const short int search_value, const short int array[], const size_t array_size) {
+	size_t low = 0;
+	size_t high = array_size;	// one past the last item that may be the one
+	size_t mid;
 
 
 //	array[0] = -32768;
@@ -116,12 +43,12 @@ bool binary_search(const short int search_value, const short int array[], const
 	printf("Debug: entering binary_search, looking for %d\n", search_value);
 #endif
 
-	while (low <= high) {
-		mid = (low + high) / 2;
+	while (low < high) {
+		mid = low + (high - low) / 2;
 		if (array[mid] < search_value) {
 			low = mid + 1;
 		} else if (array[mid] > search_value) {
-			high = mid - 1;
+			high = mid;
 		} else {
 #if DEBUG > 0
 			printf("Debug: leaving binary_search (found)\n");
@@ -149,75 +76,82 @@ bool binary_search(const short int search_value, const short int array[], const
  * return value: 1 if there was an error, else 0
  **********/
 int main(void) {
-	FILE *file;
-	char input[INPUT_SIZE];
-	short int num_items;
+	LineReader *file;
+	char *input;
+	size_t num_items;
 
 #if DEBUG > 0
 	printf("\nDebug: Reading data from %s\n", DATA_FILE);
 #endif
 
 	// open data file for reading
-	file = fopen(DATA_FILE, "r");
+	file = line_reader_open(DATA_FILE);
 	if (file == NULL) {
 		fprintf(stderr, "Unable to open file %s for reading\n", DATA_FILE);
 		return 1;
 	}
 
 	// get the first line in the file
-	if (fgets(input, INPUT_SIZE, file) == NULL) {
+	if ((input = line_reader_next(file)) == NULL) {
 		fprintf(stderr, "Unable to read from %s\n", DATA_FILE);
+		line_reader_close(file);
 		return 1;
 	}
 
 #if DEBUG > 1
-	printf("Debug: read first line of input: %s", input);
+	printf("Debug: read first line of input: %s\n", input);
 #endif
 
 	// the first line is an integer representing the number of lines of data to sort
-	if (sscanf(input, "%hd", &num_items) != 1) {
+	if (!parse_count(input, &num_items)) {
 		fprintf(stderr, "Invalid count of data items in first line of %s\n", DATA_FILE);
-		fclose(file);
+		line_reader_close(file);
 		return 1;
 	}
 
 #if DEBUG > 1
-	printf("Debug: num_items %d\n", num_items);
+	printf("Debug: num_items %ld\n", (long) num_items);
 #endif
 
-	short int data[num_items];
+	// (there may be far too many items for the stack)
+	short int *data = alloc_items(num_items);
+	if (data == NULL) {
+		fprintf(stderr, "Unable to allocate %ld bytes for %ld data items\n", (long) (num_items * sizeof(short int)), (long) num_items);
+		line_reader_close(file);
+		return 1;
+	}
 
-	// (scanf returns the number of items it parses.  If the values and types are not
-	// what it is expecting ("%hd" indicates exactly one short integer) it will return
-	// the number of values it was able to parse, which will not match the number of
-	// values specified in the format string ("%hd").  In this case, if the format
-	// of the input is what we are expecting, scanf will return 1.
+	// (parse_item, like sscanf with "%hd", only accepts a line that starts with
+	// a short integer.)
 	//
-	// while we are not at the end of the file and we have valid data on an input line...
-	int i = 0;
-	while (fgets(input, INPUT_SIZE, file) != NULL && sscanf(input, "%hd", &data[i]) == 1) {
+	// while we are not at the end of the file, have room for more and have valid
+	// data on an input line...
+	size_t i = 0;
+	while (i < num_items && (input = line_reader_next(file)) != NULL && parse_item(input, &data[i])) {
 #if DEBUG > 1
-		printf("Debug: parsed %d from %s", data[i], input);
+		printf("Debug: parsed %d from %s\n", data[i], input);
 #endif
 		i++;
 	}
 
 	// make sure our data matches up with what we expect
 	if (num_items != i) {
-		fprintf(stderr, "Number of data lines in %s (%d) is less than specified in first line in %s (%d)\n", DATA_FILE, i, DATA_FILE, num_items);
-		fclose(file);
+		if (!file->error)
+			fprintf(stderr, "Number of data lines in %s (%ld) is less than specified in first line in %s (%ld)\n", DATA_FILE, (long) i, DATA_FILE, (long) num_items);
+		line_reader_close(file);
+		free_items(data, num_items);
 		return 1;
 	}
 
 	// done with the input file
-	fclose(file);
+	line_reader_close(file);
 
 #if DEBUG > 0
-	printf("Debug: Done reading data from %s; %d records read\n", DATA_FILE, num_items);
+	printf("Debug: Done reading data from %s; %ld records read\n", DATA_FILE, (long) num_items);
 #endif
 
 	int found = 0;
-	bubble_sort(data, num_items, DESCENDING);
+	counting_sort(data, num_items, ASCENDING, (int) sysconf(_SC_NPROCESSORS_ONLN));
 	if (binary_search(data[num_items-1], data, num_items))
 		found ++;
 	if (binary_search(data[num_items-1]-1, data, num_items))
@@ -226,5 +160,6 @@ int main(void) {
 	printf("Found %d item(s) in array\n", found);
 	printf("Highest item value %d\n", data[num_items-1]);
 
+	free_items(data, num_items);
 	return 0;
 }
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <itemfile.h>
+
+/*********
+ * line_reader_open - opens a file to be read a line at a time.  The file is read
+ * 					  READ_CHUNK bytes at a time, however long it is.
+ *
+ * input:
+ * 		file_name - the name of the file
+ *
+ * output: none
+ *
+ * return value: the reader, to be closed with line_reader_close, or NULL if the
+ * 				 file cannot be opened (this is not reported)
+ **********/
+LineReader *line_reader_open(const char *file_name)
+{
+	LineReader *lr = (LineReader *)calloc(1, sizeof(LineReader));
+	if (!lr) {
+		return NULL;
+	}
+	lr->fd = open(file_name, O_RDONLY);
+	lr->buf_size = READ_CHUNK;
+	lr->buf = (char *)malloc(lr->buf_size + 1);		// plus a newline after the last line
+	if (lr->fd < 0 || !lr->buf) {
+		line_reader_close(lr);
+		return NULL;
+	}
+	return lr;
+}
+
+/*********
+ * line_reader_next - returns the next line of the file
+ *
+ * input:
+ * 		lr - the reader
+ *
+ * output: none
+ *
+ * return value: the line, without its newline, which stays valid until the next
+ * 				 call; or NULL at the end of the file or if there is an error (then
+ * 				 lr->error is set and a message has been printed)
+ **********/
+char *line_reader_next(LineReader *lr)
+{
+	for (;;) {
+		char *line = lr->buf + lr->start;
+		char *nl = (char *)memchr(line, '\n', lr->len - lr->start);
+		if (nl) {
+			*nl = '\0';
+			lr->start = (size_t)(nl + 1 - lr->buf);
+			return line;
+		}
+		if (lr->at_end || lr->error) {
+			return NULL;
+		}
+
+		// keep the partial line and read more after it
+		lr->len -= lr->start;
+		memmove(lr->buf, lr->buf + lr->start, lr->len);
+		lr->start = 0;
+		if (lr->len == lr->buf_size) {
+			// one line fills the whole buffer, make room for more of it
+			char *bigger = (char *)realloc(lr->buf, lr->buf_size * 2 + 1);
+			if (!bigger) {
+				fprintf(stderr, "Unable to allocate %ld bytes for file buffer\n", (long) lr->buf_size * 2 + 1);
+				lr->error = true;
+				return NULL;
+			}
+			lr->buf = bigger;
+			lr->buf_size *= 2;
+		}
+
+		ssize_t n = read(lr->fd, lr->buf + lr->len, lr->buf_size - lr->len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Unable to read from file\n");
+			lr->error = true;
+			return NULL;
+		}
+		if (n == 0) {
+			// the last line may not end with a newline
+			lr->at_end = true;
+			if (lr->len > 0)
+				lr->buf[lr->len++] = '\n';
+		}
+		lr->len += (size_t)n;
+	}
+}
+
+void line_reader_close(LineReader *lr)
+{
+	if (lr) {
+		if (lr->fd >= 0)
+			close(lr->fd);
+		free(lr->buf);
+		free(lr);
+	}
+}
+
+/*********
+ * parse_count - parses the count of items on the first line of a data file: a
+ * 				 number of at least one, and small enough for that many items to
+ * 				 fit in memory
+ *
+ * input:
+ * 		line - the line
+ *
+ * output:
+ * 		count - the count
+ *
+ * return value: true if the line starts with a valid count, else false
+ **********/
+bool parse_count(const char *line, size_t *count)
+{
+	const size_t max = SIZE_MAX / sizeof(short int);
+	while (*line == ' ' || *line == '\t')
+		line++;
+	if (*line == '+')
+		line++;
+	if (*line < '0' || *line > '9')
+		return false;
+	size_t n = 0;
+	for (; *line >= '0' && *line <= '9'; line++) {
+		unsigned digit = (unsigned)(*line - '0');
+		if (n > (max - digit) / 10)
+			return false;
+		n = n * 10 + digit;
+	}
+	*count = n;
+	return n > 0;
+}
+
+/*********
+ * parse_item - parses a short int at the start of a line, as sscanf's "%hd" would
+ * 				(leading blanks and a sign are allowed, and anything after the
+ * 				digits is ignored), except that a value too big for a short int is
+ * 				not valid
+ *
+ * input:
+ * 		line - the line
+ *
+ * output:
+ * 		item - the value
+ *
+ * return value: true if the line starts with a valid short int, else false
+ **********/
+bool parse_item(const char *line, short int *item)
+{
+	while (*line == ' ' || *line == '\t')
+		line++;
+	bool negative = *line == '-';
+	if (*line == '-' || *line == '+')
+		line++;
+	if (*line < '0' || *line > '9')
+		return false;
+	int value = 0;
+	for (; *line >= '0' && *line <= '9'; line++) {
+		value = value * 10 + (*line - '0');
+		if (value > 32768)
+			return false;
+	}
+	if (negative)
+		value = -value;
+	if (value > 32767)
+		return false;
+	*item = (short int)value;
+	return true;
+}
+
+// how much memory alloc_items takes for count items
+static size_t items_length(size_t count)
+{
+	size_t bytes = count * sizeof(short int);
+	if (bytes < HUGE_PAGE_SIZE)
+		return bytes;
+	return (bytes + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+}
+
+/*********
+ * alloc_items - allocates an array for items.  A big array is mapped in huge pages
+ * 				 if the system has some set aside, or else asks for transparent
+ * 				 huge pages, so that sorting and searching hundreds of millions of
+ * 				 items does not spend its time missing the TLB; a small one comes
+ * 				 from malloc.
+ *
+ * input:
+ * 		count - the number of items
+ *
+ * output: none
+ *
+ * return value: the array, to be freed with free_items, or NULL if there is not
+ * 				 enough memory (this is not reported)
+ **********/
+short int *alloc_items(size_t count)
+{
+	size_t length = items_length(count);
+	if (length < HUGE_PAGE_SIZE)
+		return (short int *)malloc(length ? length : 1);
+
+	void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p == MAP_FAILED) {
+		p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return NULL;
+		madvise(p, length, MADV_HUGEPAGE);
+	}
+	return (short int *)p;
+}
+
+/*********
+ * free_items - frees an array from alloc_items
+ *
+ * input:
+ * 		items - the array
+ * 		count - the number of items it was allocated for
+ *
+ * output: none
+ *
+ * return value: none
+ **********/
+void free_items(short int *items, size_t count)
+{
+	size_t length = items_length(count);
+	if (length < HUGE_PAGE_SIZE)
+		free(items);
+	else if (items)
+		munmap(items, length);
+}
@@ -0,0 +1,31 @@
+#ifndef ITEMFILE_H
+#define ITEMFILE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define READ_CHUNK		(1 << 20)	// bytes read from the file at a time
+#define HUGE_PAGE_SIZE	(2 << 20)	// arrays at least this big are mapped in huge pages
+
+// a file being read a line at a time
+typedef struct line_reader_struct {
+	int fd;
+	char *buf;					// the part of the file read but not yet returned
+	size_t buf_size;
+	size_t start;				// where the next line starts in buf
+	size_t len;					// bytes in buf
+	bool at_end;				// the whole file has been read into buf
+	bool error;					// a read failed (a message has been printed)
+} LineReader;
+
+LineReader *line_reader_open(const char *file_name);
+char *line_reader_next(LineReader *lr);
+void line_reader_close(LineReader *lr);
+
+bool parse_count(const char *line, size_t *count);
+bool parse_item(const char *line, short int *item);
+
+short int *alloc_items(size_t count);
+void free_items(short int *items, size_t count);
+
+#endif